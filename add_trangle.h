@@ -1,246 +1,466 @@
-// add_trangle.cpp - ģͼغ
-
-#include <windows.h>
-#include <gdiplus.h>
-#include <vector>
-#include <string>
-#include <fstream>
-#include <sstream>
-#include <bits/stdc++.h>
-#include "vector.h"
-#pragma comment(lib, "gdiplus.lib")
-
-using namespace Gdiplus;
-using namespace std;
-
-// ݽṹ
-struct TextureData {
-    string filename;
-    int width, height;
-    COLORREF* pixels;   // ɫ
-    BYTE* alpha;        // ͸ͨ
-    bool loaded;        // ǷѼ
-};
-
-// 
-vector<TextureData> textureCache;
-
-// ַתַֽ
-std::string WideToMultiByte(const std::wstring& wstr) {
-    if (wstr.empty()) return std::string();
-    int size = WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), -1, nullptr, 0, nullptr, nullptr);
-    if (size == 0) return std::string();
-    std::string str(size, 0);
-    WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), -1, &str[0], size, nullptr, nullptr);
-    if (!str.empty() && str.back() == '\0') {
-        str.pop_back();
-    }
-    return str;
-}
-
-// ڻв
-TextureData* findTexture(const string& filename) {
-    for (auto& tex : textureCache) {
-        if (tex.filename == filename && tex.loaded) {
-            return &tex;
-        }
-    }
-    return nullptr;
-}
-
-// PNGʹGDI+
-bool loadPNGTexture(const wchar_t* filename, TextureData& texData) {
-    // ʼGDI+
-    static ULONG_PTR gdiplusToken = 0;
-    if (gdiplusToken == 0) {
-        GdiplusStartupInput gdiplusStartupInput;
-        GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
-    }
-    
-    Bitmap* bitmap = Bitmap::FromFile(filename);
-    if (bitmap == NULL || bitmap->GetLastStatus() != Ok) {
-        cout << "Failed to load texture: " << filename << endl;
-        return false;
-    }
-    
-    texData.width = bitmap->GetWidth();
-    texData.height = bitmap->GetHeight();
-    texData.pixels = new COLORREF[texData.width * texData.height];
-    texData.alpha = new BYTE[texData.width * texData.height];
-    
-    for (int y = 0; y < texData.height; y++) {
-        for (int x = 0; x < texData.width; x++) {
-            Color color;
-            bitmap->GetPixel(x, y, &color);
-            
-            // 洢ɫ͸
-            texData.pixels[y * texData.width + x] = 
-                RGB(color.GetRed(), color.GetGreen(), color.GetBlue());
-            texData.alpha[y * texData.width + x] = color.GetAlpha();
-        }
-    }
-    
-    delete bitmap;
-    texData.loaded = true;
-    cout << "Texture loaded: " << filename << " (" << texData.width << "x" << texData.height << ")" << endl;
-    return true;
-}
-
-// 
-COLORREF sampleTexture(const TextureData& tex, double u, double v, BYTE& alpha) {
-    // ظ
-    u = u - floor(u);
-    v = v - floor(v);
-    
-    // ȷ[0,1)Χ
-    if (u < 0) u = 0;
-    if (u >= 1) u = 0.9999;
-    if (v < 0) v = 0;
-    if (v >= 1) v = 0.9999;
-    
-    int x = (int)(1.0 * u * tex.width);
-    int y = (int)(1.0 * v * tex.height);
-    
-    // ߽
-    if (x < 0) x = 0;
-    if (x >= tex.width) x = tex.width - 1;
-    if (y < 0) y = 0;
-    if (y >= tex.height) y = tex.height - 1;
-    
-    int index = y * tex.width + x;
-    alpha = tex.alpha[index];
-    return tex.pixels[index];
-}
-
-// OBJģļ
-bool loadOBJModel(const char* filename) {
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cout << "Failed to open OBJ file: " << filename << endl;
-        return false;
-    }
-    
-    vector<Point3D> vertices;
-    vector<Point3D> texCoords;
-    vector<Point3D> normals;
-    vector<vector<pair<int,int> > > faces;
-    
-    string line;
-    while (getline(file, line)) {
-        istringstream iss(line);
-        string type;
-        iss >> type;
-        
-        if (type == "v") {  // 
-            Point3D v;
-            iss >> v.x >> v.y >> v.z;
-            vertices.push_back(v);
-        }
-        else if (type == "vt") {  // 
-            Point3D vt;
-            iss >> vt.x >> vt.y;
-            vt.z = 0;
-            vt.y = 1.0 - vt.y;  // תY
-            texCoords.push_back(vt);
-        }
-        else if (type == "vn") {  // 
-            Point3D vn;
-            iss >> vn.x >> vn.y >> vn.z;
-            normals.push_back(vn);
-        }
-        else if (type == "f") {  // 
-            vector<pair<int,int> > face;
-            string token;
-            while (iss >> token) {
-                replace(token.begin(), token.end(), '/', ' ');
-                istringstream tokenStream(token);
-                int v, vt = -1, vn = -1;
-                tokenStream >> v;
-                if (tokenStream >> vt) {
-                    if (tokenStream >> vn) {
-                        // 
-                    }
-                }
-                face.push_back(make_pair(v-1, vt-1));
-            }
-            faces.push_back(face);
-        }
-    }
-    
-    file.close();
-    
-    // 
-    for (const auto& face : faces) {
-        if (face.size() == 3) {
-            Point3D v1 = vertices[face[0].first];
-            Point3D v2 = vertices[face[1].first];
-            Point3D v3 = vertices[face[2].first];
-            
-            triangles[triangleCount].points[0] = v1;
-            triangles[triangleCount].points[1] = v2;
-            triangles[triangleCount].points[2] = v3;
-            
-            // 
-            if (face[0].second >= 0 && face[0].second < texCoords.size())
-                triangles[triangleCount].x[0] = texCoords[face[0].second].x;
-            if (face[1].second >= 0 && face[1].second < texCoords.size())
-                triangles[triangleCount].x[1] = texCoords[face[1].second].x;
-            if (face[2].second >= 0 && face[2].second < texCoords.size())
-                triangles[triangleCount].x[2] = texCoords[face[2].second].x;
-                
-            if (face[0].second >= 0 && face[0].second < texCoords.size())
-                triangles[triangleCount].y[0] = texCoords[face[0].second].y;
-            if (face[1].second >= 0 && face[1].second < texCoords.size())
-                triangles[triangleCount].y[1] = texCoords[face[1].second].y;
-            if (face[2].second >= 0 && face[2].second < texCoords.size())
-                triangles[triangleCount].y[2] = texCoords[face[2].second].y;
-            
-            triangles[triangleCount].color = RGB(rand()%255, rand()%255, rand()%255);
-            triangles[triangleCount].materialType = 1;
-            triangles[triangleCount].is_image = false;
-            triangleCount++;
-            
-            if (triangleCount >= 1000000) {
-                cout << "Warning: Triangle limit reached" << endl;
-                break;
-            }
-        }
-    }
-    
-    cout << "OBJ loaded: " << filename << " (" << triangleCount << " triangles)" << endl;
-    return true;
-}
-
-// شģ
-bool ProcessModelWithTexture(const char* objFile, const wchar_t* textureFile) {
-	int to_start=triangleCount;
-    cout << "Processing model with texture..." << endl;
-    
-    // 1. 
-    TextureData tex;
-    tex.filename = WideToMultiByte(textureFile);
-    if (!loadPNGTexture(textureFile, tex)) {
-        cout << "Failed to load texture" << endl;
-        return false;
-    }
-    textureCache.push_back(tex);
-    
-    // 2. OBJģ
-    if (!loadOBJModel(objFile)) {
-        cout << "Failed to load OBJ model" << endl;
-        return false;
-    }
-    
-    // 3. ΪÿϢ
-    TextureData* loadedTex = findTexture(WideToMultiByte(textureFile));
-    if (loadedTex) {
-        for (int i = to_start; i < triangleCount; i++) {
-            triangles[i].is_image = true;
-            triangles[i].image = WideToMultiByte(textureFile);
-            appear[i] = 1;
-        }
-        cout << "Texture assigned to " << triangleCount << " triangles" << endl;
-    }
-    
-    return true;
-}
+// add_trangle.cpp - 模型加载和纹理处理
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <bits/stdc++.h>
+#include "vector.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <gdiplus.h>
+#pragma comment(lib, "gdiplus.lib")
+using namespace Gdiplus;
+#else
+#include <png.h>    // 非Windows平台使用libpng解码纹理（链接时加 -lpng）
+#endif
+
+using namespace std;
+
+// 纹理存储布局
+enum TextureLayout {
+    TEXTURE_LINEAR = 0,     // 按行存放
+    TEXTURE_TILED = 1       // 4x4纹素一块（64字节，正好一条缓存行），块内按Morton顺序，块按行存放
+};
+
+const int TEXTURE_TILE = 4;
+
+// 一个缓存行的纹素（保证纹理数据按64字节对齐，分块布局下每块正好一行）
+struct alignas(64) TexelBlock {
+    unsigned int texel[TEXTURE_TILE * TEXTURE_TILE];
+};
+
+// 纹理过滤方式（都在按光线锥选出的mip级别上采样）
+enum TextureFilter {
+    TEXTURE_FILTER_NEAREST = 0,     // 最近纹素
+    TEXTURE_FILTER_BILINEAR = 1,    // 最近级别内双线性
+    TEXTURE_FILTER_TRILINEAR = 2    // 相邻两级双线性再按LOD插值
+};
+
+// mip金字塔的一级
+struct TextureLevel {
+    int width, height;
+    int tilesX;                     // 分块布局下每行的块数
+    size_t offset;                  // 在storage中的起始块
+};
+
+// 纹理数据结构
+// 纹素为打包的RGBA8：低24位与COLORREF相同（0x00BBGGRR），最高字节为透明度，一次读取即得到颜色和透明度
+struct TextureData {
+    string filename;
+    int width = 0, height = 0;
+    int layout = TEXTURE_LINEAR;
+    vector<TextureLevel> levels;    // mip金字塔，levels[0]为原图，逐级宽高减半直到1x1
+    MappedArray<TexelBlock> storage;    // 各级纹素依次存放，每级从块边界开始（分块布局下宽高补齐到4的倍数）
+    bool loaded = false;            // 是否已加载
+    
+    unsigned int* texels(int level = 0) { return storage[levels[level].offset].texel; }
+    const unsigned int* texels(int level = 0) const { return storage[levels[level].offset].texel; }
+};
+
+int textureLayout = TEXTURE_TILED;                  // 新加载纹理使用的布局
+int textureFilter = TEXTURE_FILTER_TRILINEAR;       // 纹理过滤方式
+bool textureMipmaps = true;                         // 按光线锥足迹选择mip级别，关闭时总是采样原图
+
+// 宽字符转多字节字符串
+std::string WideToMultiByte(const std::wstring& wstr) {
+    if (wstr.empty()) return std::string();
+#ifdef _WIN32
+    int size = WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), -1, nullptr, 0, nullptr, nullptr);
+    if (size == 0) return std::string();
+    std::string str(size, 0);
+    WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), -1, &str[0], size, nullptr, nullptr);
+#else
+    size_t size = wcstombs(nullptr, wstr.c_str(), 0);
+    if (size == (size_t)-1) return std::string();
+    std::string str(size + 1, 0);
+    wcstombs(&str[0], wstr.c_str(), size + 1);
+#endif
+    if (!str.empty() && str.back() == '\0') {
+        str.pop_back();
+    }
+    return str;
+}
+
+// 多字节字符串转宽字符
+std::wstring MultiByteToWide(const std::string& str) {
+    if (str.empty()) return std::wstring();
+#ifdef _WIN32
+    int size = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, nullptr, 0);
+    if (size == 0) return std::wstring();
+    std::wstring wstr(size, 0);
+    MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, &wstr[0], size);
+#else
+    size_t size = mbstowcs(nullptr, str.c_str(), 0);
+    if (size == (size_t)-1) return std::wstring();
+    std::wstring wstr(size + 1, 0);
+    mbstowcs(&wstr[0], str.c_str(), size + 1);
+#endif
+    if (!wstr.empty() && wstr.back() == L'\0') {
+        wstr.pop_back();
+    }
+    return wstr;
+}
+
+// 纹素(x, y)在其所在级别中的下标
+inline int texelIndex(const TextureData& tex, const TextureLevel& level, int x, int y) {
+    if (tex.layout == TEXTURE_LINEAR) return y * level.width + x;
+    // 4x4块内的Morton顺序：x0 y0 x1 y1
+    int inner = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+    return ((y >> 2) * level.tilesX + (x >> 2)) * (TEXTURE_TILE * TEXTURE_TILE) + inner;
+}
+
+// 读取第level级的纹素(x, y)
+inline unsigned int fetchTexel(const TextureData& tex, int level, int x, int y) {
+    const TextureLevel& l = tex.levels[level];
+    return tex.storage[l.offset].texel[texelIndex(tex, l, x, y)];
+}
+
+// 给定尺寸和布局的一级需要的TexelBlock数（分块布局下宽高补齐到4的倍数）
+size_t texelBlockCount(int width, int height, int layout) {
+    size_t blockTexels = TEXTURE_TILE * TEXTURE_TILE;
+    if (layout != TEXTURE_LINEAR) {
+        return (size_t)((width + TEXTURE_TILE - 1) / TEXTURE_TILE) * ((height + TEXTURE_TILE - 1) / TEXTURE_TILE);
+    }
+    return ((size_t)width * height + blockTexels - 1) / blockTexels;
+}
+
+// 计算整个mip金字塔的各级尺寸和位置，返回需要的TexelBlock总数
+size_t layoutTextureLevels(TextureData& tex, int width, int height, int layout) {
+    tex.width = width;
+    tex.height = height;
+    tex.layout = layout;
+    tex.levels.clear();
+    size_t blocks = 0;
+    while (true) {
+        TextureLevel level;
+        level.width = width;
+        level.height = height;
+        level.tilesX = (width + TEXTURE_TILE - 1) / TEXTURE_TILE;
+        level.offset = blocks;
+        tex.levels.push_back(level);
+        blocks += texelBlockCount(width, height, layout);
+        if (width == 1 && height == 1) break;
+        width = max(1, width / 2);
+        height = max(1, height / 2);
+    }
+    return blocks;
+}
+
+// 按当前布局为整个mip金字塔分配纹素存储
+void allocateTexels(TextureData& tex, int width, int height) {
+    tex.storage.assign(layoutTextureLevels(tex, width, height, textureLayout), TexelBlock());
+}
+
+// 把一行RGBA8（按R, G, B, A字节顺序）写入原图的第y行
+void storeTexelRow(TextureData& tex, int y, const unsigned char* rgba) {
+    unsigned int* texels = tex.texels();
+    for (int x = 0; x < tex.width; x++) {
+        const unsigned char* p = rgba + x * 4;
+        texels[texelIndex(tex, tex.levels[0], x, y)] = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+    }
+}
+
+// 由原图逐级生成mip金字塔：每个纹素取上一级对应2x2纹素的平均（奇数边长时最后一行/列重复使用）
+void buildTextureMips(TextureData& tex) {
+    for (size_t k = 1; k < tex.levels.size(); k++) {
+        const TextureLevel& src = tex.levels[k - 1];
+        const TextureLevel& dst = tex.levels[k];
+        unsigned int* out = tex.texels(k);
+        for (int y = 0; y < dst.height; y++) {
+            int y0 = min(y * 2, src.height - 1), y1 = min(y * 2 + 1, src.height - 1);
+            for (int x = 0; x < dst.width; x++) {
+                int x0 = min(x * 2, src.width - 1), x1 = min(x * 2 + 1, src.width - 1);
+                unsigned int quad[4] = {
+                    fetchTexel(tex, k - 1, x0, y0), fetchTexel(tex, k - 1, x1, y0),
+                    fetchTexel(tex, k - 1, x0, y1), fetchTexel(tex, k - 1, x1, y1)
+                };
+                unsigned int texel = 0;
+                for (int shift = 0; shift < 32; shift += 8) {
+                    unsigned int sum = 2;
+                    for (int i = 0; i < 4; i++) sum += (quad[i] >> shift) & 0xFF;
+                    texel |= (sum / 4) << shift;
+                }
+                out[texelIndex(tex, dst, x, y)] = texel;
+            }
+        }
+    }
+}
+
+#ifdef _WIN32
+// 初始化GDI+（只执行一次；纹理在渲染线程上按需解码，用局部静态变量保证并发调用时只初始化一次）
+void startupGdiplus() {
+    static ULONG_PTR gdiplusToken = [] {
+        ULONG_PTR token = 0;
+        GdiplusStartupInput gdiplusStartupInput;
+        GdiplusStartup(&token, &gdiplusStartupInput, NULL);
+        return token;
+    }();
+    (void)gdiplusToken;
+}
+
+// 加载PNG纹理（使用GDI+）
+bool loadPNGTexture(const wchar_t* filename, TextureData& texData) {
+    // 初始化GDI+
+    startupGdiplus();
+    
+    Bitmap* bitmap = Bitmap::FromFile(filename);
+    if (bitmap == NULL || bitmap->GetLastStatus() != Ok) {
+        cout << "Failed to load texture: " << filename << endl;
+        return false;
+    }
+    
+    // 整幅锁定为32位ARGB（内存中按B, G, R, A字节顺序），逐行转换
+    int width = bitmap->GetWidth(), height = bitmap->GetHeight();
+    Rect rect(0, 0, width, height);
+    BitmapData data;
+    if (bitmap->LockBits(&rect, ImageLockModeRead, PixelFormat32bppARGB, &data) != Ok) {
+        delete bitmap;
+        cout << "Failed to load texture: " << filename << endl;
+        return false;
+    }
+    
+    allocateTexels(texData, width, height);
+    vector<unsigned char> row(width * 4);
+    for (int y = 0; y < height; y++) {
+        const unsigned char* src = (const unsigned char*)data.Scan0 + (ptrdiff_t)y * data.Stride;
+        for (int x = 0; x < width; x++) {
+            row[x * 4 + 0] = src[x * 4 + 2];
+            row[x * 4 + 1] = src[x * 4 + 1];
+            row[x * 4 + 2] = src[x * 4 + 0];
+            row[x * 4 + 3] = src[x * 4 + 3];
+        }
+        storeTexelRow(texData, y, row.data());
+    }
+    
+    bitmap->UnlockBits(&data);
+    delete bitmap;
+    buildTextureMips(texData);
+    texData.loaded = true;
+    cout << "Texture loaded: " << filename << " (" << texData.width << "x" << texData.height << ")" << endl;
+    return true;
+}
+#else
+// 用libpng把fp解码到texData。出错时libpng会longjmp回setjmp处，跳过之后构造的对象的析构函数，
+// 所以这里不能有需要析构的局部对象：临时图像和行指针由调用者持有
+bool decodePNG(FILE* fp, TextureData& texData, vector<png_byte>& image, vector<png_bytep>& rows) {
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if (png == NULL || info == NULL || setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, NULL);
+        return false;
+    }
+    
+    png_init_io(png, fp);
+    png_read_info(png, info);
+    
+    // 统一转换为8位RGBA
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+    png_read_update_info(png, info);
+    
+    allocateTexels(texData, png_get_image_width(png, info), png_get_image_height(png, info));
+    
+    // 整幅读入（自动处理隔行扫描）：按行布局时R, G, B, A字节在小端机器上就是打包的纹素，直接解码到纹理中；
+    // 分块布局先解码到临时图像再逐行重排
+    size_t rowBytes = png_get_rowbytes(png, info);
+    bool direct = texData.layout == TEXTURE_LINEAR && rowBytes == (size_t)texData.width * 4;
+    image.assign(direct ? 0 : rowBytes * texData.height, 0);
+    rows.assign(texData.height, NULL);
+    for (int y = 0; y < texData.height; y++) {
+        rows[y] = direct ? (png_bytep)(texData.texels() + (size_t)y * texData.width) : &image[y * rowBytes];
+    }
+    png_read_image(png, rows.data());
+    
+    if (!direct) {
+        for (int y = 0; y < texData.height; y++) {
+            storeTexelRow(texData, y, rows[y]);
+        }
+    }
+    
+    png_read_end(png, NULL);
+    png_destroy_read_struct(&png, &info, NULL);
+    return true;
+}
+
+// 加载PNG纹理（使用libpng）
+bool loadPNGTexture(const wchar_t* filename, TextureData& texData) {
+    string path = WideToMultiByte(filename);
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) {
+        cout << "Failed to load texture: " << path << endl;
+        return false;
+    }
+    
+    vector<png_byte> image;
+    vector<png_bytep> rows;
+    bool decoded = decodePNG(fp, texData, image, rows);
+    fclose(fp);
+    if (!decoded) {
+        cout << "Failed to load texture: " << path << endl;
+        return false;
+    }
+    buildTextureMips(texData);
+    texData.loaded = true;
+    cout << "Texture loaded: " << path << " (" << texData.width << "x" << texData.height << ")" << endl;
+    return true;
+}
+#endif
+
+// 第level级上的双线性采样（纹素中心在(i + 0.5) / 宽度，坐标按重复方式环绕），结果为各通道0-255的浮点值
+void bilinearTexel(const TextureData& tex, int level, double u, double v, double rgba[4]) {
+    const TextureLevel& l = tex.levels[level];
+    double x = u * l.width - 0.5, y = v * l.height - 0.5;
+    double fx = floor(x), fy = floor(y);
+    double wx = x - fx, wy = y - fy;
+    int x0 = ((int)fx % l.width + l.width) % l.width, y0 = ((int)fy % l.height + l.height) % l.height;
+    int x1 = (x0 + 1) % l.width, y1 = (y0 + 1) % l.height;
+    unsigned int t00 = fetchTexel(tex, level, x0, y0), t10 = fetchTexel(tex, level, x1, y0);
+    unsigned int t01 = fetchTexel(tex, level, x0, y1), t11 = fetchTexel(tex, level, x1, y1);
+    for (int c = 0; c < 4; c++) {
+        int shift = c * 8;
+        double top = ((t00 >> shift) & 0xFF) * (1 - wx) + ((t10 >> shift) & 0xFF) * wx;
+        double bottom = ((t01 >> shift) & 0xFF) * (1 - wx) + ((t11 >> shift) & 0xFF) * wx;
+        rgba[c] = top * (1 - wy) + bottom * wy;
+    }
+}
+
+// 纹理采样：lod为mip级别（可带小数，0为原图），按textureFilter过滤
+COLORREF sampleTexture(const TextureData& tex, double u, double v, BYTE& alpha, double lod = 0) {
+    // 处理纹理坐标重复
+    u = u - floor(u);
+    v = v - floor(v);
+    
+    // 确保坐标在[0,1)范围内
+    if (u < 0) u = 0;
+    if (u >= 1) u = 0.9999;
+    if (v < 0) v = 0;
+    if (v >= 1) v = 0.9999;
+    
+    int maxLevel = tex.levels.size() - 1;
+    lod = textureMipmaps ? min(max(lod, 0.0), (double)maxLevel) : 0.0;
+    
+    if (textureFilter == TEXTURE_FILTER_NEAREST) {
+        int level = (int)(lod + 0.5);
+        const TextureLevel& l = tex.levels[level];
+        int x = min((int)(u * l.width), l.width - 1);
+        int y = min((int)(v * l.height), l.height - 1);
+        unsigned int texel = fetchTexel(tex, level, x, y);
+        alpha = texel >> 24;
+        return texel & 0xFFFFFF;
+    }
+    
+    double rgba[4];
+    if (textureFilter == TEXTURE_FILTER_BILINEAR) {
+        bilinearTexel(tex, (int)(lod + 0.5), u, v, rgba);
+    } else {
+        int level = (int)lod;
+        double blend = lod - level;
+        bilinearTexel(tex, level, u, v, rgba);
+        if (blend > 0 && level < maxLevel) {
+            double next[4];
+            bilinearTexel(tex, level + 1, u, v, next);
+            for (int c = 0; c < 4; c++) rgba[c] += (next[c] - rgba[c]) * blend;
+        }
+    }
+    alpha = (BYTE)(rgba[3] + 0.5);
+    return RGB(rgba[0] + 0.5, rgba[1] + 0.5, rgba[2] + 0.5);
+}
+
+// 光线锥在命中点处的纹理LOD（Akenine-Moller等，Ray Tracing Gems第20章）：
+// 0.5*log2(纹素面积/三角形面积) + log2(锥宽/|cos入射角|)
+double textureLod(const Ray& ray, const HitRecord& hit, const TextureData& tex) {
+    const Triangle& tri = triangles[hit.triangle];
+    double worldArea = hit.area;
+    double texelArea = fabs((tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0])) *
+                       tex.width * tex.height;
+    double width = ray.coneWidth + ray.coneSpread * hit.t;
+    double cosTheta = fabs(ray.direction[0] * hit.normal[0] + ray.direction[1] * hit.normal[1] +
+                           ray.direction[2] * hit.normal[2]);
+    if (worldArea <= 0 || texelArea <= 0 || width <= 0 || cosTheta <= 1e-6) return 0.0;
+    return 0.5 * log2(texelArea / worldArea) + log2(width / cosTheta);
+}
+
+// 解析OBJ模型文件
+bool loadOBJModel(const char* filename) {
+    auto start = chrono::steady_clock::now();
+    ObjMesh mesh;
+    if (!parseOBJFile(filename, mesh)) {
+        cout << "Failed to open OBJ file: " << filename << endl;
+        return false;
+    }
+    double parseMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    
+    // 创建三角形（颜色按三角形顺序取随机数，与文件解析的分块方式无关）
+    int vertexCount = mesh.positions.size() / 3;
+    int texCount = mesh.texCoords.size() / 2;
+    int normalCount = mesh.normalCount;
+    int badFaces = 0;
+    reserveTriangles(triangleCount + mesh.corners.size() / 3);   // 按解析出的面数一次分配
+    for (size_t k = 0; k + 2 < mesh.corners.size(); k += 3) {
+        const ObjCorner* face = &mesh.corners[k];
+        bool valid = true;
+        for (int i = 0; i < 3; i++) {
+            if (face[i].v < 0 || face[i].v >= vertexCount || face[i].vt >= texCount ||
+                face[i].vn >= normalCount) valid = false;
+        }
+        if (!valid) {
+            badFaces++;
+            continue;
+        }
+        
+        Triangle& tri = triangles[triangleCount];
+        for (int i = 0; i < 3; i++) {
+            const double* v = &mesh.positions[face[i].v * 3];
+            tri.points[i].x = v[0];
+            tri.points[i].y = v[1];
+            tri.points[i].z = v[2];
+            
+            // 设置纹理坐标
+            tri.x[i] = face[i].vt >= 0 ? mesh.texCoords[face[i].vt * 2] : 0.0;
+            tri.y[i] = face[i].vt >= 0 ? mesh.texCoords[face[i].vt * 2 + 1] : 0.0;
+        }
+        
+        tri.color = RGB(rand()%255, rand()%255, rand()%255);
+        tri.materialType = 1;
+        tri.textureId = -1;
+        triangleCount++;
+    }
+    
+    if (badFaces + mesh.skippedFaces > 0) {
+        cout << "Warning: skipped " << badFaces + mesh.skippedFaces << " invalid faces" << endl;
+    }
+    cout << "OBJ loaded: " << filename << " (" << triangleCount << " triangles, "
+         << vertexCount << " vertices, " << normalCount << " normals, parsed in " << parseMs << " ms)" << endl;
+    return true;
+}
+
+// 主函数：加载带纹理的模型
+bool ProcessModelWithTexture(const char* objFile, const wchar_t* textureFile) {
+	int to_start=triangleCount;
+    cout << "Processing model with texture..." << endl;
+    
+    // 1. 注册纹理（第一次采样时才解码，这里只确认文件可读）
+    int textureId = registerTexture(WideToMultiByte(textureFile));
+    if (!textureAvailable(textureId)) {
+        cout << "Failed to load texture" << endl;
+        return false;
+    }
+    
+    // 2. 加载OBJ模型
+    if (!loadOBJModel(objFile)) {
+        cout << "Failed to load OBJ model" << endl;
+        return false;
+    }
+    
+    // 3. 为每个三角形设置纹理信息
+    for (int i = to_start; i < triangleCount; i++) {
+        triangles[i].textureId = textureId;
+        appear[i] = 1;
+    }
+    cout << "Texture assigned to " << triangleCount << " triangles" << endl;
+    
+    return true;
+}
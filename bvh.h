@@ -1,252 +1,604 @@
-// bvh.cpp - Χвνṹʵ
-
-#include "vector.h"
-#include <bits/stdc++.h>
-#include <graphics.h>
-using namespace std;
-
-// ΰΧ
-AABB computeTriangleAABB(const Triangle& tri) {
-    AABB bbox;
-    
-    // ʼ
-    bbox.min[0] = bbox.max[0] = tri.points[0].x;
-    bbox.min[1] = bbox.max[1] = tri.points[0].y;
-    bbox.min[2] = bbox.max[2] = tri.points[0].z;
-    
-    // չΧ
-    for (int i = 1; i < 3; i++) {
-        bbox.min[0] = min(bbox.min[0], tri.points[i].x);
-        bbox.max[0] = max(bbox.max[0], tri.points[i].x);
-        bbox.min[1] = min(bbox.min[1], tri.points[i].y);
-        bbox.max[1] = max(bbox.max[1], tri.points[i].y);
-        bbox.min[2] = min(bbox.min[2], tri.points[i].z);
-        bbox.max[2] = max(bbox.max[2], tri.points[i].z);
-    }
-    
-    // ݲֵ
-    for (int i = 0; i < 3; i++) {
-        bbox.min[i] -= 1e-6;
-        bbox.max[i] += 1e-6;
-    }
-    
-    return bbox;
-}
-
-// ϲΧ
-AABB mergeAABB(const AABB& a, const AABB& b) {
-    AABB result;
-    
-    result.min[0] = min(a.min[0], b.min[0]);
-    result.min[1] = min(a.min[1], b.min[1]);
-    result.min[2] = min(a.min[2], b.min[2]);
-    
-    result.max[0] = max(a.max[0], b.max[0]);
-    result.max[1] = max(a.max[1], b.max[1]);
-    result.max[2] = max(a.max[2], b.max[2]);
-    
-    return result;
-}
-
-// ָȽΣBVH
-bool compareTrianglesByAxis(int a, int b, int axis) {
-    AABB bboxA = computeTriangleAABB(triangles[a]);
-    AABB bboxB = computeTriangleAABB(triangles[b]);
-    
-    double centerA = (bboxA.min[axis] + bboxA.max[axis]) * 0.5;
-    double centerB = (bboxB.min[axis] + bboxB.max[axis]) * 0.5;
-    
-    return centerA < centerB;
-}
-
-// ཻԣM?ller-Trumbore㷨
-bool intersectTriangle(Ray ray, Triangle tri, HitRecord& hit) {
-    const double EPSILON = 1e-6;
-    
-    double edge1[3], edge2[3], h[3], s[3], q[3];
-    double a, f, u, v;
-    
-    Point3D v0 = tri.points[0], v1 = tri.points[1], v2 = tri.points[2];
-    
-    edge1[0] = v1.x - v0.x; edge1[1] = v1.y - v0.y; edge1[2] = v1.z - v0.z;
-    edge2[0] = v2.x - v0.x; edge2[1] = v2.y - v0.y; edge2[2] = v2.z - v0.z;
-    
-    cross(ray.direction, edge2, h);
-    a = dot(edge1, h);
-    
-    if (a > -EPSILON && a < EPSILON) return false;
-    
-    f = 1.0 / a;
-    s[0] = ray.origin[0] - v0.x;
-    s[1] = ray.origin[1] - v0.y;
-    s[2] = ray.origin[2] - v0.z;
-    
-    u = f * dot(s, h);
-    if (u < 0.0 || u > 1.0) return false;
-    
-    cross(s, edge1, q);
-    v = f * dot(ray.direction, q);
-    if (v < 0.0 || u + v > 1.0) return false;
-    
-    double t = f * dot(edge2, q);
-    if (t > EPSILON && t < hit.t) {
-        hit.t = t;
-        hit.position[0] = ray.origin[0] + ray.direction[0] * t;
-        hit.position[1] = ray.origin[1] + ray.direction[1] * t;
-        hit.position[2] = ray.origin[2] + ray.direction[2] * t;
-        hit.hit = true;
-        
-        double normal[3];
-        cross(edge1, edge2, normal);
-        normalize(normal);
-        hit.normal[0] = normal[0];
-        hit.normal[1] = normal[1];
-        hit.normal[2] = normal[2];
-        
-        hit.color = tri.color;
-        hit.materialType = tri.materialType;
-        
-        // ֵ
-        double baryU = 1.0 - u - v;
-        double baryV = u;
-        double baryW = v;
-        
-        // ֵ
-        hit.tex_u = baryU * tri.x[0] + baryV * tri.x[1] + baryW * tri.x[2];
-        hit.tex_v = baryU * tri.y[0] + baryV * tri.y[1] + baryW * tri.y[2];
-        hit.hasTexture = tri.is_image;
-        hit.texturePath = tri.image;
-        
-        return true;
-    }
-    
-    return false;
-}
-
-// BVHݹ飩
-BVHNode* buildBVH(int start, int end, int depth) {
-    if (end - start <= 0) return nullptr;
-    
-    BVHNode* node = new BVHNode();
-    node->startIndex = start;
-    node->endIndex = end;
-    
-    // 㵱ǰڵİΧ
-    node->bbox = computeTriangleAABB(triangles[triangleIndices[start]]);
-    for (int i = start + 1; i < end; i++) {
-        AABB triAABB = computeTriangleAABB(triangles[triangleIndices[i]]);
-        node->bbox = mergeAABB(node->bbox, triAABB);
-    }
-    
-    // ٻߴﵽȣҶӽڵ
-    if (end - start <= 5 || depth >= 50) {
-        node->isLeaf = true;
-        node->left = node->right = nullptr;
-        return node;
-    }
-    
-    // ѡл
-    double extent[3] = {
-        node->bbox.max[0] - node->bbox.min[0],
-        node->bbox.max[1] - node->bbox.min[1],
-        node->bbox.max[2] - node->bbox.min[2]
-    };
-    
-    int axis = 0;
-    if (extent[1] > extent[axis]) axis = 1;
-    if (extent[2] > extent[axis]) axis = 2;
-    
-    // 
-    sort(triangleIndices.begin() + start, triangleIndices.begin() + end,
-         [axis](int a, int b) { return compareTrianglesByAxis(a, b, axis); });
-    
-    // мָ
-    int mid = start + (end - start) / 2;
-    
-    // ݹ鹹
-    node->isLeaf = false;
-    node->left = buildBVH(start, mid, depth + 1);
-    node->right = buildBVH(mid, end, depth + 1);
-    
-    return node;
-}
-
-// AABBཻԣSlab
-bool intersectAABB(const Ray& ray, const AABB& bbox, double& tMin, double& tMax) {
-    tMin = -1e9;
-    tMax = 1e9;
-    
-    for (int i = 0; i < 3; i++) {
-        if (fabs(ray.direction[i]) < 1e-9) {
-            // ƽƽ
-            if (ray.origin[i] < bbox.min[i] || ray.origin[i] > bbox.max[i]) {
-                return false;
-            }
-        } else {
-            double t1 = (bbox.min[i] - ray.origin[i]) / ray.direction[i];
-            double t2 = (bbox.max[i] - ray.origin[i]) / ray.direction[i];
-            
-            if (t1 > t2) swap(t1, t2);
-            
-            tMin = max(tMin, t1);
-            tMax = min(tMax, t2);
-            
-            if (tMin > tMax) return false;
-        }
-    }
-    
-    return tMax > 1e-6; // ȷtMax
-}
-
-// BVHཻ
-void intersectBVH(BVHNode* node, const Ray& ray, HitRecord& hit) {
-    if (node == nullptr) return;
-    
-    double tMin, tMax;
-    if (!intersectAABB(ray, node->bbox, tMin, tMax)) {
-        return;
-    }
-    
-    if (tMin > hit.t) {
-        return; // иཻ
-    }
-    
-    if (node->isLeaf) {
-        // Ҷӽڵ㣺
-        for (int i = node->startIndex; i < node->endIndex; i++) {
-            if(appear[triangleIndices[i]] == 1) 
-                intersectTriangle(ray, triangles[triangleIndices[i]], hit);
-        }
-    } else {
-        // ڲڵ㣺ݹӽڵ
-        intersectBVH(node->left, ray, hit);
-        intersectBVH(node->right, ray, hit);
-    }
-}
-
-// ͷBVHڴ
-void deleteBVH(BVHNode* node) {
-    if (node == nullptr) return;
-    
-    if (!node->isLeaf) {
-        deleteBVH(node->left);
-        deleteBVH(node->right);
-    }
-    
-    delete node;
-}
-
-// ʼBVH
-void initBVH() {
-    if (triangleCount == 0) return;
-    
-    // 
-    triangleIndices.resize(triangleCount);
-    for (int i = 0; i < triangleCount; i++) {
-        triangleIndices[i] = i;
-    }
-    
-    // BVH
-    bvhRoot = buildBVH(0, triangleCount, 0);
-    cout << "BVHɣ: " << triangleCount << endl;
-}
+// bvh.cpp - 包围盒层次结构实现
+
+#include "vector.h"
+#include <bits/stdc++.h>
+#include <omp.h>
+using namespace std;
+
+// 计算三角形包围盒
+AABB computeTriangleAABB(const Triangle& tri) {
+    AABB bbox;
+    
+    // 初始化
+    bbox.min[0] = bbox.max[0] = tri.points[0].x;
+    bbox.min[1] = bbox.max[1] = tri.points[0].y;
+    bbox.min[2] = bbox.max[2] = tri.points[0].z;
+    
+    // 扩展包围盒
+    for (int i = 1; i < 3; i++) {
+        bbox.min[0] = min(bbox.min[0], tri.points[i].x);
+        bbox.max[0] = max(bbox.max[0], tri.points[i].x);
+        bbox.min[1] = min(bbox.min[1], tri.points[i].y);
+        bbox.max[1] = max(bbox.max[1], tri.points[i].y);
+        bbox.min[2] = min(bbox.min[2], tri.points[i].z);
+        bbox.max[2] = max(bbox.max[2], tri.points[i].z);
+    }
+    
+    // 添加容差避免数值误差
+    for (int i = 0; i < 3; i++) {
+        bbox.min[i] -= 1e-6;
+        bbox.max[i] += 1e-6;
+    }
+    
+    return bbox;
+}
+
+// 合并两个包围盒
+AABB mergeAABB(const AABB& a, const AABB& b) {
+    AABB result;
+    
+    result.min[0] = min(a.min[0], b.min[0]);
+    result.min[1] = min(a.min[1], b.min[1]);
+    result.min[2] = min(a.min[2], b.min[2]);
+    
+    result.max[0] = max(a.max[0], b.max[0]);
+    result.max[1] = max(a.max[1], b.max[1]);
+    result.max[2] = max(a.max[2], b.max[2]);
+    
+    return result;
+}
+
+// 包围盒表面积（SAH代价计算用）
+double surfaceArea(const AABB& box) {
+    double dx = box.max[0] - box.min[0];
+    double dy = box.max[1] - box.min[1];
+    double dz = box.max[2] - box.min[2];
+    if (dx < 0 || dy < 0 || dz < 0) return 0.0;
+    return 2.0 * (dx * dy + dy * dz + dz * dx);
+}
+
+// 用点扩展包围盒
+void growAABB(AABB& box, const Point3D& p) {
+    box.min[0] = min(box.min[0], p.x); box.max[0] = max(box.max[0], p.x);
+    box.min[1] = min(box.min[1], p.y); box.max[1] = max(box.max[1], p.y);
+    box.min[2] = min(box.min[2], p.z); box.max[2] = max(box.max[2], p.z);
+}
+
+// 构建时预先计算的三角形包围盒和质心（按三角形编号索引）
+vector<AABB> primBounds;
+vector<Point3D> primCentroids;
+
+// 光线与热数据g中第slot个三角形求交（M?ller-Trumbore算法），只读取顶点和边
+inline bool rayTriangle(const TriangleGeometry& g, const Ray& ray, int slot, double tMax, 
+                        double& t, double& u, double& v) {
+    const double EPSILON = 1e-6;
+    
+    double edge1[3] = {g.e1[0][slot], g.e1[1][slot], g.e1[2][slot]};
+    double edge2[3] = {g.e2[0][slot], g.e2[1][slot], g.e2[2][slot]};
+    double dir[3] = {ray.direction[0], ray.direction[1], ray.direction[2]};
+    double h[3], s[3], q[3];
+    
+    cross(dir, edge2, h);
+    double a = dot(edge1, h);
+    if (a > -EPSILON && a < EPSILON) return false;
+    
+    double f = 1.0 / a;
+    s[0] = ray.origin[0] - g.v0[0][slot];
+    s[1] = ray.origin[1] - g.v0[1][slot];
+    s[2] = ray.origin[2] - g.v0[2][slot];
+    
+    u = f * dot(s, h);
+    if (u < 0.0 || u > 1.0) return false;
+    
+    cross(s, edge1, q);
+    v = f * dot(dir, q);
+    if (v < 0.0 || u + v > 1.0) return false;
+    
+    t = f * dot(edge2, q);
+    return t > EPSILON && t < tMax;
+}
+
+// 光线与三角形相交测试：更近时只记录t、三角形位置和重心坐标，其余属性由resolveHit统一计算
+inline bool intersectTriangle(const TriangleGeometry& g, const Ray& ray, int slot, HitRecord& hit) {
+    double t, u, v;
+    if (!rayTriangle(g, ray, slot, hit.t, t, u, v)) return false;
+    
+    hit.t = t;
+    hit.prim = slot;
+    hit.baryU = u;
+    hit.baryV = v;
+    hit.hit = true;
+    return true;
+}
+
+// 遍历结束后计算最终命中的属性：位置、法线、纹理坐标、颜色和材质
+// edge1/edge2为命中三角形在世界空间中的两条边（网格实例的边先经过实例变换）
+void resolveTriangleHit(const Ray& ray, HitRecord& hit, int id, double edge1[3], double edge2[3]) {
+    const Triangle& tri = triangles[id];
+    double t = hit.t;
+    
+    hit.position[0] = ray.origin[0] + ray.direction[0] * t;
+    hit.position[1] = ray.origin[1] + ray.direction[1] * t;
+    hit.position[2] = ray.origin[2] + ray.direction[2] * t;
+    
+    double normal[3];
+    cross(edge1, edge2, normal);
+    hit.area = sqrt(dot(normal, normal));
+    normalize(normal);
+    hit.normal[0] = normal[0];
+    hit.normal[1] = normal[1];
+    hit.normal[2] = normal[2];
+    
+    hit.triangle = id;
+    hit.color = tri.color;
+    hit.materialType = tri.materialType;
+    
+    // 计算重心坐标用于纹理插值
+    double baryU = 1.0 - hit.baryU - hit.baryV;
+    double baryV = hit.baryU;
+    double baryW = hit.baryV;
+    
+    // 插值纹理坐标
+    hit.tex_u = baryU * tri.x[0] + baryV * tri.x[1] + baryW * tri.x[2];
+    hit.tex_v = baryU * tri.y[0] + baryV * tri.y[1] + baryW * tri.y[2];
+    hit.textureId = tri.textureId;
+}
+
+// 光线与三角形遮挡测试：只判断(EPSILON, tMax)内是否相交，不计算命中属性
+bool occludesTriangle(const TriangleGeometry& g, const Ray& ray, int slot, double tMax) {
+    double t, u, v;
+    return rayTriangle(g, ray, slot, tMax, t, u, v);
+}
+
+// 由triangles[triangleIndices[slot]]写入热数据中第slot个三角形
+inline void storeTriangleGeometry(int slot) {
+    const Triangle& tri = triangles[triangleIndices[slot]];
+    const Point3D& p0 = tri.points[0];
+    const Point3D& p1 = tri.points[1];
+    const Point3D& p2 = tri.points[2];
+    triGeometry.v0[0][slot] = p0.x;
+    triGeometry.v0[1][slot] = p0.y;
+    triGeometry.v0[2][slot] = p0.z;
+    triGeometry.e1[0][slot] = p1.x - p0.x;
+    triGeometry.e1[1][slot] = p1.y - p0.y;
+    triGeometry.e1[2][slot] = p1.z - p0.z;
+    triGeometry.e2[0][slot] = p2.x - p0.x;
+    triGeometry.e2[1][slot] = p2.y - p0.y;
+    triGeometry.e2[2][slot] = p2.z - p0.z;
+}
+
+// 按BVH叶子顺序生成三角形热数据（float顶点和边）
+void buildTriangleGeometry() {
+    // 末尾补齐4个元素，SIMD内核一次读取4个三角形时不会越界
+    int n = triangleIndices.size();
+    for (int k = 0; k < 3; k++) {
+        triGeometry.v0[k].assign(n + 4, 0.0f);
+        triGeometry.e1[k].assign(n + 4, 0.0f);
+        triGeometry.e2[k].assign(n + 4, 0.0f);
+    }
+    
+    #pragma omp parallel for schedule(static)
+    for (int slot = 0; slot < n; slot++) storeTriangleGeometry(slot);
+}
+
+// SAH分桶
+struct SAHBin {
+    AABB bounds;
+    int count = 0;
+};
+
+const int MAX_SAH_BINS = 64;                // 分桶数上限
+const int PARALLEL_BUILD_THRESHOLD = 4096;  // 超过此数量的子树作为独立任务并行构建
+const int PARALLEL_BIN_CHUNK = 32768;       // 大节点按块并行统计包围盒和分桶
+
+// 一段三角形的统计结果：包围盒、质心包围盒和三个轴上的分桶
+struct BinStats {
+    AABB bounds;
+    AABB centroidBounds;
+    vector<SAHBin> bins[3];
+    
+    BinStats(int binCount) {
+        for (int axis = 0; axis < 3; axis++) bins[axis].resize(binCount);
+    }
+};
+
+// 计算[start, end)的包围盒和质心包围盒
+void computeRangeBounds(int start, int end, AABB& bounds, AABB& centroidBounds) {
+    for (int i = start; i < end; i++) {
+        bounds = mergeAABB(bounds, primBounds[triangleIndices[i]]);
+        growAABB(centroidBounds, primCentroids[triangleIndices[i]]);
+    }
+}
+
+// 把[start, end)的三角形按质心放入三个轴的桶中
+void binRange(int start, int end, const AABB& centroidBounds, int binCount, 
+              vector<SAHBin> bins[3]) {
+    double scale[3];
+    for (int axis = 0; axis < 3; axis++) {
+        double extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+        scale[axis] = extent > 1e-12 ? binCount / extent : 0.0;
+    }
+    
+    for (int i = start; i < end; i++) {
+        int id = triangleIndices[i];
+        for (int axis = 0; axis < 3; axis++) {
+            double c = (&primCentroids[id].x)[axis];
+            int b = min(binCount - 1, (int)((c - centroidBounds.min[axis]) * scale[axis]));
+            bins[axis][b].count++;
+            bins[axis][b].bounds = mergeAABB(bins[axis][b].bounds, primBounds[id]);
+        }
+    }
+}
+
+// 统计节点的包围盒和分桶；三角形很多时分块并行（OpenMP任务）
+void gatherBinStats(int start, int end, int binCount, BinStats& stats) {
+    int count = end - start;
+    if (count < 2 * PARALLEL_BIN_CHUNK) {
+        computeRangeBounds(start, end, stats.bounds, stats.centroidBounds);
+        binRange(start, end, stats.centroidBounds, binCount, stats.bins);
+        return;
+    }
+    
+    int chunks = (count + PARALLEL_BIN_CHUNK - 1) / PARALLEL_BIN_CHUNK;
+    vector<BinStats> partial(chunks, BinStats(binCount));
+    
+    // 第一遍：各块包围盒
+    #pragma omp taskloop shared(partial, stats)
+    for (int c = 0; c < chunks; c++) {
+        int s = start + c * PARALLEL_BIN_CHUNK;
+        computeRangeBounds(s, min(end, s + PARALLEL_BIN_CHUNK), 
+                           partial[c].bounds, partial[c].centroidBounds);
+    }
+    for (int c = 0; c < chunks; c++) {
+        stats.bounds = mergeAABB(stats.bounds, partial[c].bounds);
+        stats.centroidBounds = mergeAABB(stats.centroidBounds, partial[c].centroidBounds);
+    }
+    
+    // 第二遍：各块分桶后合并
+    #pragma omp taskloop shared(partial, stats)
+    for (int c = 0; c < chunks; c++) {
+        int s = start + c * PARALLEL_BIN_CHUNK;
+        binRange(s, min(end, s + PARALLEL_BIN_CHUNK), stats.centroidBounds, binCount, partial[c].bins);
+    }
+    for (int c = 0; c < chunks; c++) {
+        for (int axis = 0; axis < 3; axis++) {
+            for (int b = 0; b < binCount; b++) {
+                stats.bins[axis][b].count += partial[c].bins[axis][b].count;
+                stats.bins[axis][b].bounds = mergeAABB(stats.bins[axis][b].bounds, 
+                                                       partial[c].bins[axis][b].bounds);
+            }
+        }
+    }
+}
+
+// 构建节点池：N个三角形的二叉树最多2N-1个节点（每次划分两侧都非空），一次分配
+// 两个子节点成对分配、在池中相邻；池在重建之间保留，容量不够时才重新分配，releaseBVH时一次free释放
+// 节点由buildBVH逐个填写，池本身不初始化（没用到的部分不占物理内存）
+struct BVHNodePool {
+    BVHNode* nodes = nullptr;
+    size_t capacity = 0;
+    atomic<size_t> used{0};
+};
+
+BVHNodePool bvhNodePool;
+
+// 为count个三角形的构建准备节点池，返回根节点（之前构建的节点全部作废）
+BVHNode* resetBVHNodePool(int count) {
+    size_t need = max(1, 2 * count - 1);
+    if (bvhNodePool.capacity < need) {
+        free(bvhNodePool.nodes);
+        bvhNodePool.nodes = (BVHNode*)malloc(need * sizeof(BVHNode));
+        if (bvhNodePool.nodes == nullptr) throw bad_alloc();
+        bvhNodePool.capacity = need;
+    }
+    bvhNodePool.used = 1;
+    return bvhNodePool.nodes;
+}
+
+// 分配一对相邻的子节点（构建任务并行调用）
+BVHNode* allocBVHNodePair() {
+    size_t k = bvhNodePool.used.fetch_add(2, memory_order_relaxed);
+    return &bvhNodePool.nodes[k];
+}
+
+void releaseBVHNodePool() {
+    free(bvhNodePool.nodes);
+    bvhNodePool.nodes = nullptr;
+    bvhNodePool.capacity = 0;
+    bvhNodePool.used = 0;
+}
+
+// 构建BVH树（递归，分桶SAH划分），填写node对应的[start, end)段，子节点从节点池成对分配
+// 需在OpenMP并行区域内由单个线程调用，大的子树会作为任务并行构建
+void buildBVH(BVHNode* node, int start, int end, int depth) {
+    node->left = node->right = nullptr;
+    node->startIndex = start;
+    node->endIndex = end;
+    node->axis = 0;
+    node->nodeCount = 1;
+    node->isLeaf = false;
+    
+    int count = end - start;
+    int maxDepth = min(bvhConfig.maxDepth, BVH_STACK_SIZE - 1);
+    int maxLeafSize = min(bvhConfig.maxLeafSize, MAX_LEAF_TRIANGLES);
+    int binCount = min(max(2, bvhConfig.binCount), MAX_SAH_BINS);
+    
+    // 计算当前节点的包围盒，并在三个轴上分桶
+    BinStats stats(binCount);
+    gatherBinStats(start, end, binCount, stats);
+    node->bbox = stats.bounds;
+    
+    // 三角形足够少或者达到最大深度，创建叶子节点
+    // 达到最大深度时三角形数超过叶子计数的范围则不能作为叶子，继续按中位数划分（只多几层）
+    bool pastMaxDepth = depth >= maxDepth;
+    if (count <= 1 || (pastMaxDepth && count <= MAX_LEAF_TRIANGLES)) {
+        node->isLeaf = true;
+        return;
+    }
+    
+    // 寻找SAH代价最小的划分面
+    double bestCost = 1e30;
+    int bestAxis = -1, bestSplit = -1;
+    double rightArea[MAX_SAH_BINS];
+    int rightCount[MAX_SAH_BINS];
+    
+    for (int axis = 0; axis < 3 && !pastMaxDepth; axis++) {
+        if (stats.centroidBounds.max[axis] - stats.centroidBounds.min[axis] <= 1e-12) continue;
+        const vector<SAHBin>& bins = stats.bins[axis];
+        
+        // 从右向左累积，再从左向右扫描每个划分面
+        AABB acc;
+        int accCount = 0;
+        for (int b = binCount - 1; b > 0; b--) {
+            acc = mergeAABB(acc, bins[b].bounds);
+            accCount += bins[b].count;
+            rightArea[b] = surfaceArea(acc);
+            rightCount[b] = accCount;
+        }
+        
+        acc = AABB();
+        accCount = 0;
+        for (int b = 0; b < binCount - 1; b++) {
+            acc = mergeAABB(acc, bins[b].bounds);
+            accCount += bins[b].count;
+            if (accCount == 0 || rightCount[b + 1] == 0) continue;
+            double cost = surfaceArea(acc) * accCount + rightArea[b + 1] * rightCount[b + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+    const AABB& centroidBounds = stats.centroidBounds;
+    
+    // 归一化代价：遍历代价 + 子节点期望相交代价（三角形测试代价记为1）
+    double parentArea = surfaceArea(node->bbox);
+    double splitCost = bvhConfig.traversalCost + 
+                       (parentArea > 0 ? bestCost / parentArea : count);
+    double leafCost = count;
+    
+    if (bestAxis < 0) {
+        // 质心重合无法分桶：数量不多则作为叶子，否则对半分
+        if (count <= maxLeafSize) {
+            node->isLeaf = true;
+            return;
+        }
+    } else if (count <= maxLeafSize && leafCost <= splitCost) {
+        node->isLeaf = true;
+        return;
+    }
+    
+    int mid;
+    if (bestAxis >= 0) {
+        double cmin = centroidBounds.min[bestAxis];
+        double scale = binCount / (centroidBounds.max[bestAxis] - cmin);
+        int axis = bestAxis, split = bestSplit;
+        mid = partition(triangleIndices.begin() + start, triangleIndices.begin() + end,
+                        [&](int id) {
+                            int b = min(binCount - 1, (int)(((&primCentroids[id].x)[axis] - cmin) * scale));
+                            return b <= split;
+                        }) - triangleIndices.begin();
+        node->axis = bestAxis;
+    } else if (pastMaxDepth) {
+        // 沿质心范围最长的轴取中位数
+        int axis = 0;
+        for (int k = 1; k < 3; k++) {
+            if (centroidBounds.max[k] - centroidBounds.min[k] > centroidBounds.max[axis] - centroidBounds.min[axis]) axis = k;
+        }
+        mid = start + count / 2;
+        nth_element(triangleIndices.begin() + start, triangleIndices.begin() + mid, triangleIndices.begin() + end,
+                    [axis](int a, int b) { return (&primCentroids[a].x)[axis] < (&primCentroids[b].x)[axis]; });
+        node->axis = axis;
+    } else {
+        mid = start + count / 2;
+        node->axis = 0;
+    }
+    
+    // 递归构建左右子树，较大的子树作为任务并行
+    BVHNode* children = allocBVHNodePair();
+    node->left = children;
+    node->right = children + 1;
+    if (count > PARALLEL_BUILD_THRESHOLD) {
+        #pragma omp task
+        buildBVH(children, start, mid, depth + 1);
+        buildBVH(children + 1, mid, end, depth + 1);
+        #pragma omp taskwait
+    } else {
+        buildBVH(children, start, mid, depth + 1);
+        buildBVH(children + 1, mid, end, depth + 1);
+    }
+    node->nodeCount = 1 + node->left->nodeCount + node->right->nodeCount;
+}
+
+// 计算树的SAH代价（用于评估树的质量）
+double computeSAHCost(BVHNode* node, double rootArea) {
+    if (node == nullptr || rootArea <= 0) return 0.0;
+    double weight = surfaceArea(node->bbox) / rootArea;
+    if (node->isLeaf) return weight * (node->endIndex - node->startIndex);
+    return weight * bvhConfig.traversalCost + 
+           computeSAHCost(node->left, rootArea) + computeSAHCost(node->right, rootArea);
+}
+
+// AABB与光线相交测试（Slab方法）
+bool intersectAABB(const Ray& ray, const AABB& bbox, double& tMin, double& tMax) {
+    tMin = -1e9;
+    tMax = 1e9;
+    
+    for (int i = 0; i < 3; i++) {
+        if (fabs(ray.direction[i]) < 1e-9) {
+            // 光线与平面平行
+            if (ray.origin[i] < bbox.min[i] || ray.origin[i] > bbox.max[i]) {
+                return false;
+            }
+        } else {
+            double t1 = (bbox.min[i] - ray.origin[i]) / ray.direction[i];
+            double t2 = (bbox.max[i] - ray.origin[i]) / ray.direction[i];
+            
+            if (t1 > t2) swap(t1, t2);
+            
+            tMin = max(tMin, t1);
+            tMax = min(tMax, t2);
+            
+            if (tMin > tMax) return false;
+        }
+    }
+    
+    return tMax > 1e-6; // 确保tMax是正数
+}
+
+// double转float并向下/向上舍入，保证float包围盒不小于原包围盒
+float roundDown(double v) {
+    float f = (float)v;
+    return f > v ? nextafterf(f, -INFINITY) : f;
+}
+
+float roundUp(double v) {
+    float f = (float)v;
+    return f < v ? nextafterf(f, INFINITY) : f;
+}
+
+// 将构建树展开到深度优先线性数组的index位置（子树节点数已知，可并行展开）
+void flattenBVH(BVHNode* node, int index) {
+    LinearBVHNode linear;
+    for (int i = 0; i < 3; i++) {
+        linear.bmin[i] = roundDown(node->bbox.min[i]);
+        linear.bmax[i] = roundUp(node->bbox.max[i]);
+    }
+    linear.axis = node->axis;
+    linear.pad = 0;
+    
+    if (node->isLeaf) {
+        linear.offset = node->startIndex;
+        assert(node->endIndex - node->startIndex <= MAX_LEAF_TRIANGLES);
+        linear.count = node->endIndex - node->startIndex;
+    } else {
+        // 第一个子节点紧随其后，只需记录第二个子节点位置
+        linear.offset = index + 1 + node->left->nodeCount;
+        linear.count = 0;
+        if (node->nodeCount > PARALLEL_BUILD_THRESHOLD) {
+            #pragma omp task
+            flattenBVH(node->left, index + 1);
+            flattenBVH(node->right, linear.offset);
+            #pragma omp taskwait
+        } else {
+            flattenBVH(node->left, index + 1);
+            flattenBVH(node->right, linear.offset);
+        }
+    }
+    
+    bvhNodes[index] = linear;
+}
+
+// 遍历用的光线参数（预先计算方向倒数）
+struct RayTraversal {
+    double origin[3];
+    double invDir[3];
+    
+    RayTraversal(const Ray& ray) {
+        for (int i = 0; i < 3; i++) {
+            origin[i] = ray.origin[i];
+            // 与坐标平面平行的分量用极大值代替，等价于原Slab方法的平行判断
+            double d = ray.direction[i];
+            if (fabs(d) < 1e-9) d = d < 0 ? -1e-9 : 1e-9;
+            invDir[i] = 1.0 / d;
+        }
+    }
+};
+
+// 初始化BVH（多线程构建，并记录各阶段耗时）
+void initBVH() {
+    if (triangleCount == 0) return;
+    
+    auto clock = []() { return chrono::steady_clock::now(); };
+    auto ms = [](chrono::steady_clock::time_point a, chrono::steady_clock::time_point b) {
+        return chrono::duration<double, milli>(b - a).count();
+    };
+    auto t0 = clock();
+    
+    // 创建三角形索引数组，预先计算每个三角形的包围盒和质心
+    triangleIndices.resize(triangleCount);
+    primBounds.resize(triangleCount);
+    primCentroids.resize(triangleCount);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < triangleCount; i++) {
+        triangleIndices[i] = i;
+        primBounds[i] = computeTriangleAABB(triangles[i]);
+        primCentroids[i].x = (primBounds[i].min[0] + primBounds[i].max[0]) * 0.5;
+        primCentroids[i].y = (primBounds[i].min[1] + primBounds[i].max[1]) * 0.5;
+        primCentroids[i].z = (primBounds[i].min[2] + primBounds[i].max[2]) * 0.5;
+    }
+    // 已删除的三角形和实例化网格的三角形不进入场景BVH
+    if (!removedTriangles.empty() || !meshTriangles.empty()) {
+        triangleIndices.erase(remove_if(triangleIndices.begin(), triangleIndices.end(), [](int id) {
+            return (id < (int)removedTriangles.size() && removedTriangles[id]) ||
+                   (id < (int)meshTriangles.size() && meshTriangles[id]);
+        }), triangleIndices.end());
+    }
+    int liveCount = triangleIndices.size();
+    if (liveCount == 0) {
+        releaseBVH();
+        triGeometry = TriangleGeometry();
+        resetBVHUpdate();
+        return;
+    }
+    auto t1 = clock();
+    
+    // 并行构建BVH（节点来自节点池）
+    BVHNode* root = resetBVHNodePool(liveCount);
+    #pragma omp parallel
+    #pragma omp single
+    buildBVH(root, 0, liveCount, 0);
+    auto t2 = clock();
+    
+    // 展开为线性数组，按叶子顺序生成三角形热数据，再折叠为四叉BVH
+    bvhNodes.assign(root->nodeCount, LinearBVHNode());
+    #pragma omp parallel
+    #pragma omp single
+    flattenBVH(root, 0);
+    buildTriangleGeometry();
+    int binaryNodeCount = bvhNodes.size();
+    buildWideBVH();
+    vector<LinearBVHNode>().swap(bvhNodes);
+    auto t3 = clock();
+    
+    // 释放临时数据（构建树留在节点池中供下次重建复用）
+    double sahCost = computeSAHCost(root, surfaceArea(root->bbox));
+    vector<AABB>().swap(primBounds);
+    vector<Point3D>().swap(primCentroids);
+    auto t4 = clock();
+    
+    cout << "BVH构建完成，三角形数量: " << liveCount << "，节点数量: " << binaryNodeCount 
+         << "（四叉节点 " << wideNodes.size() << "），SAH代价: " << sahCost 
+         << "，线程数: " << omp_get_max_threads() << endl;
+    cout << "BVH构建耗时: 预处理 " << ms(t0, t1) << " ms，建树 " << ms(t1, t2) 
+         << " ms，展开 " << ms(t2, t3) << " ms，释放 " << ms(t3, t4) 
+         << " ms，总计 " << ms(t0, t4) << " ms" << endl;
+}
+
+// 释放BVH
+void releaseBVH() {
+    vector<LinearBVHNode>().swap(bvhNodes);
+    sceneBVH = WideBVH();
+    releaseBVHNodePool();
+}
@@ -0,0 +1,615 @@
+// bvh_update.cpp - BVH增量更新：移动、插入、删除或显示/隐藏三角形后只重新拟合受影响的四叉节点，树质量下降的子树局部重建
+
+#include "vector.h"
+#include <bits/stdc++.h>
+#include <omp.h>
+using namespace std;
+
+// 增量更新参数
+struct BVHUpdateConfig {
+    double rebuildThreshold = 2.0;  // 节点表面积超过构建时的这个倍数时重建该子树
+    double garbageRatio = 0.5;      // 废弃的节点或三角形位置超过有效部分的这个比例时整棵树重建（压缩存储）
+    int parallelRefit = 256;        // 同一层需要拟合的节点超过此数时并行
+};
+
+// 最近一次updateBVH的统计
+struct BVHUpdateStats {
+    int refitNodes = 0;             // 重新拟合的四叉节点数
+    int insertedTriangles = 0;      // 插入的三角形数
+    int rebuiltSubtrees = 0;        // 局部重建的子树数
+    int rebuiltTriangles = 0;       // 局部重建涉及的三角形数
+    bool fullRebuild = false;       // 是否整棵树重建
+    double ms = 0;
+};
+
+BVHUpdateConfig bvhUpdateConfig;
+BVHUpdateStats bvhUpdateStats;
+unsigned int sceneRevision = 0;     // 每次updateBVH改变场景后加一，渐进累积和重投影缓存据此失效
+
+// 增量更新用的附加信息：第一次修改场景时由当前四叉BVH生成，整棵树重建或从缓存加载后失效
+// 四叉节点和三角形位置只追加不移动，局部重建替换下来的部分成为废弃数据，直到下次整棵树重建
+struct BVHUpdateState {
+    bool valid = false;
+    vector<int> parent;             // 四叉节点的父节点，根为-1，已废弃为-2
+    vector<unsigned char> parentSlot; // 在父节点中是第几个子节点
+    vector<int> height;             // 子树高度（只有叶子子节点时为1）
+    vector<float> buildArea;        // 构建时的表面积，负数表示新节点（下次拟合时记录）
+    vector<char> dirty;
+    vector<int> dirtyNodes;         // 需要重新拟合的节点（标记时连同所有祖先）
+    vector<int> triangleSlot;       // 三角形编号 -> 在triangleIndices中的位置，不在树中为-1
+    vector<int> slotLeaf;           // 位置 -> 所在叶子（四叉节点 * 4 + 子节点），废弃位置为-1
+    vector<int> pendingInserts;     // 等待下次updateBVH插入的三角形
+    long long deadSlots = 0, deadNodes = 0;
+};
+
+BVHUpdateState bvhUpdate;
+
+// 整棵树重建或从缓存加载后调用：附加信息失效，下次修改时重新生成
+void resetBVHUpdate() {
+    bvhUpdate = BVHUpdateState();
+}
+
+// 附加信息的数组跟上节点、位置和三角形数量
+void growBVHUpdate() {
+    BVHUpdateState& st = bvhUpdate;
+    size_t nodes = wideNodes.size();
+    st.parent.resize(nodes, -1);
+    st.parentSlot.resize(nodes, 0);
+    st.height.resize(nodes, 1);
+    st.buildArea.resize(nodes, -1.0f);
+    st.dirty.resize(nodes, 0);
+    st.slotLeaf.resize(triangleIndices.size(), -1);
+    if ((int)st.triangleSlot.size() < triangleCount) st.triangleSlot.resize(triangleCount, -1);
+}
+
+// 三角形在热数据中的位置，不在树中返回-1
+inline int triangleSlotOf(int id) {
+    return id < (int)bvhUpdate.triangleSlot.size() ? bvhUpdate.triangleSlot[id] : -1;
+}
+
+inline bool isTriangleRemoved(int id) {
+    return id < (int)removedTriangles.size() && removedTriangles[id];
+}
+
+// 四叉节点所有子节点包围盒的并集的表面积（空节点为0）
+double wideNodeArea(int n) {
+    const WideBVHNode& node = wideNodes[n];
+    float lo[3] = {INFINITY, INFINITY, INFINITY}, hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (int c = 0; c < 4; c++) {
+        for (int axis = 0; axis < 3; axis++) {
+            lo[axis] = min(lo[axis], node.bmin[axis][c]);
+            hi[axis] = max(hi[axis], node.bmax[axis][c]);
+        }
+    }
+    if (lo[0] > hi[0] || lo[1] > hi[1] || lo[2] > hi[2]) return 0.0;
+    double dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+    return 2.0 * (dx * dy + dy * dz + dz * dx);
+}
+
+// 记录子树中各节点的父节点、各三角形位置所在的叶子
+void linkWideSubtree(int root, int parent, int slot) {
+    BVHUpdateState& st = bvhUpdate;
+    st.parent[root] = parent;
+    st.parentSlot[root] = slot;
+    vector<int> stack(1, root);
+    while (!stack.empty()) {
+        int n = stack.back();
+        stack.pop_back();
+        const WideBVHNode& node = wideNodes[n];
+        for (int c = 0; c < 4; c++) {
+            if (node.child[c] < 0) continue;
+            if (node.count[c] > 0) {
+                for (int s = node.child[c]; s < node.child[c] + node.count[c]; s++) {
+                    st.slotLeaf[s] = n * 4 + c;
+                    st.triangleSlot[triangleIndices[s]] = s;
+                }
+            } else {
+                st.parent[node.child[c]] = n;
+                st.parentSlot[node.child[c]] = c;
+                stack.push_back(node.child[c]);
+            }
+        }
+    }
+}
+
+// 由当前四叉BVH生成附加信息（已生成时直接返回）
+void initBVHUpdate() {
+    BVHUpdateState& st = bvhUpdate;
+    if (st.valid) return;
+    st.valid = true;
+    growBVHUpdate();
+    if (wideNodes.empty()) return;
+    
+    // 从缓存加载的树没有记录外扩量，按根节点包围盒的坐标量级重新计算（与buildWideBVH相同）
+    if (wideBoxPad <= 0) {
+        float magnitude = 1.0f;
+        for (int c = 0; c < 4; c++) {
+            for (int axis = 0; axis < 3; axis++) {
+                if (wideNodes[0].child[c] < 0) continue;
+                magnitude = max(magnitude, fabsf(wideNodes[0].bmin[axis][c]));
+                magnitude = max(magnitude, fabsf(wideNodes[0].bmax[axis][c]));
+            }
+        }
+        wideBoxPad = magnitude * 1e-6f;
+    }
+    
+    linkWideSubtree(0, -1, 0);
+    // 构建得到的四叉节点按深度优先顺序存放，子节点下标总是大于父节点
+    for (int n = wideNodes.size() - 1; n >= 0; n--) {
+        const WideBVHNode& node = wideNodes[n];
+        int h = 1;
+        for (int c = 0; c < 4; c++) {
+            if (node.child[c] >= 0 && node.count[c] == 0) h = max(h, st.height[node.child[c]] + 1);
+        }
+        st.height[n] = h;
+        st.buildArea[n] = wideNodeArea(n);
+    }
+}
+
+// 标记节点及其祖先需要重新拟合
+void markWideDirty(int n) {
+    BVHUpdateState& st = bvhUpdate;
+    while (n >= 0 && !st.dirty[n]) {
+        st.dirty[n] = 1;
+        st.dirtyNodes.push_back(n);
+        n = st.parent[n];
+    }
+}
+
+// 节点深度（根为0）
+int wideNodeDepth(int n) {
+    int depth = 0;
+    for (int p = bvhUpdate.parent[n]; p >= 0; p = bvhUpdate.parent[p]) depth++;
+    return depth;
+}
+
+// 交换热数据中两个位置的三角形（同一叶子内）
+void swapTriangleSlots(int a, int b) {
+    if (a == b) return;
+    swap(triangleIndices[a], triangleIndices[b]);
+    for (int k = 0; k < 3; k++) {
+        swap(triGeometry.v0[k][a], triGeometry.v0[k][b]);
+        swap(triGeometry.e1[k][a], triGeometry.e1[k][b]);
+        swap(triGeometry.e2[k][a], triGeometry.e2[k][b]);
+    }
+    bvhUpdate.triangleSlot[triangleIndices[a]] = a;
+    bvhUpdate.triangleSlot[triangleIndices[b]] = b;
+}
+
+// 重新计算节点n的四个子节点包围盒和子树高度（子节点须已拟合）
+// 叶子只包含可见三角形，全部隐藏的叶子和子树得到空包围盒，遍历时直接跳过
+void refitWideNode(int n) {
+    WideBVHNode& node = wideNodes[n];
+    float pad = wideBoxPad;
+    int h = 1;
+    for (int c = 0; c < 4; c++) {
+        float lo[3] = {INFINITY, INFINITY, INFINITY}, hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+        if (node.child[c] >= 0 && node.count[c] > 0) {
+            AABB box;
+            bool any = false;
+            for (int s = node.child[c]; s < node.child[c] + node.count[c]; s++) {
+                int id = triangleIndices[s];
+                if (appear[id] != 1) continue;
+                box = mergeAABB(box, computeTriangleAABB(triangles[id]));
+                any = true;
+            }
+            if (any) {
+                for (int axis = 0; axis < 3; axis++) {
+                    lo[axis] = roundDown(box.min[axis]) - pad;
+                    hi[axis] = roundUp(box.max[axis]) + pad;
+                }
+            }
+        } else if (node.child[c] >= 0) {
+            // 子节点的包围盒已经外扩过，直接取并集
+            const WideBVHNode& child = wideNodes[node.child[c]];
+            for (int k = 0; k < 4; k++) {
+                for (int axis = 0; axis < 3; axis++) {
+                    lo[axis] = min(lo[axis], child.bmin[axis][k]);
+                    hi[axis] = max(hi[axis], child.bmax[axis][k]);
+                }
+            }
+            h = max(h, bvhUpdate.height[node.child[c]] + 1);
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            node.bmin[axis][c] = lo[axis];
+            node.bmax[axis][c] = hi[axis];
+        }
+    }
+    bvhUpdate.height[n] = h;
+}
+
+// 自底向上重新拟合所有标记的节点：按深度分层，同一层的节点互不依赖，可以并行
+// 返回表面积超过构建时阈值倍数的节点
+vector<int> refitDirtyNodes() {
+    BVHUpdateState& st = bvhUpdate;
+    vector<vector<int>> levels;
+    for (size_t i = 0; i < st.dirtyNodes.size(); i++) {
+        int n = st.dirtyNodes[i];
+        if (st.parent[n] == -2) continue;
+        int depth = wideNodeDepth(n);
+        if ((int)levels.size() <= depth) levels.resize(depth + 1);
+        levels[depth].push_back(n);
+    }
+    
+    vector<int> degraded;
+    for (int d = levels.size() - 1; d >= 0; d--) {
+        const vector<int>& level = levels[d];
+        int count = level.size();
+        #pragma omp parallel for schedule(static) if (count > bvhUpdateConfig.parallelRefit)
+        for (int k = 0; k < count; k++) refitWideNode(level[k]);
+        
+        for (int k = 0; k < count; k++) {
+            int n = level[k];
+            double area = wideNodeArea(n);
+            if (st.buildArea[n] < 0) st.buildArea[n] = area;
+            else if (st.buildArea[n] > 0 && area > st.buildArea[n] * bvhUpdateConfig.rebuildThreshold) degraded.push_back(n);
+        }
+    }
+    
+    bvhUpdateStats.refitNodes += st.dirtyNodes.size();
+    for (size_t i = 0; i < st.dirtyNodes.size(); i++) st.dirty[st.dirtyNodes[i]] = 0;
+    st.dirtyNodes.clear();
+    return degraded;
+}
+
+// 为一组三角形构建新的四叉子树：三角形追加到热数据末尾，节点追加到wideNodes末尾，返回子树根
+// depth为子树挂接处的深度，用于限制总深度；新节点的父节点由调用者设置
+int buildWideSubtree(const vector<int>& ids, int depth) {
+    int m = ids.size();
+    int base = triangleIndices.size();
+    
+    // 借用全局的构建数组：以0..m-1为临时编号构建二叉树
+    vector<int> saved;
+    triangleIndices.swap(saved);
+    triangleIndices.resize(m);
+    primBounds.resize(m);
+    primCentroids.resize(m);
+    #pragma omp parallel for schedule(static) if (m > PARALLEL_BUILD_THRESHOLD)
+    for (int k = 0; k < m; k++) {
+        triangleIndices[k] = k;
+        primBounds[k] = computeTriangleAABB(triangles[ids[k]]);
+        primCentroids[k].x = (primBounds[k].min[0] + primBounds[k].max[0]) * 0.5;
+        primCentroids[k].y = (primBounds[k].min[1] + primBounds[k].max[1]) * 0.5;
+        primCentroids[k].z = (primBounds[k].min[2] + primBounds[k].max[2]) * 0.5;
+    }
+    BVHNode* root = resetBVHNodePool(m);
+    #pragma omp parallel
+    #pragma omp single
+    buildBVH(root, 0, m, min(depth, bvhConfig.maxDepth / 2));
+    bvhNodes.assign(root->nodeCount, LinearBVHNode());
+    #pragma omp parallel
+    #pragma omp single
+    flattenBVH(root, 0);
+    vector<AABB>().swap(primBounds);
+    vector<Point3D>().swap(primCentroids);
+    
+    // 临时编号换回三角形编号，追加到热数据末尾（末尾仍补齐4个元素）
+    vector<int> order;
+    triangleIndices.swap(order);
+    triangleIndices.swap(saved);
+    triangleIndices.resize(base + m);
+    for (int k = 0; k < m; k++) triangleIndices[base + k] = ids[order[k]];
+    for (int k = 0; k < 3; k++) {
+        triGeometry.v0[k].resize(base + m + 4, 0.0f);
+        triGeometry.e1[k].resize(base + m + 4, 0.0f);
+        triGeometry.e2[k].resize(base + m + 4, 0.0f);
+    }
+    for (int slot = base; slot < base + m; slot++) storeTriangleGeometry(slot);
+    
+    // 折叠为四叉节点，叶子位置加上偏移
+    int first = wideNodes.size();
+    int wideRoot = collapseBVH(0, wideBoxPad);
+    vector<LinearBVHNode>().swap(bvhNodes);
+    for (int n = first; n < (int)wideNodes.size(); n++) {
+        for (int c = 0; c < 4; c++) {
+            if (wideNodes[n].count[c] > 0) wideNodes[n].child[c] += base;
+        }
+    }
+    growBVHUpdate();
+    linkWideSubtree(wideRoot, -1, 0);
+    return wideRoot;
+}
+
+// 新子树的所有节点标记为需要拟合（隐藏三角形剪枝，并记录构建时的表面积）
+void markWideSubtreeDirty(int first) {
+    for (int n = first; n < (int)wideNodes.size(); n++) {
+        bvhUpdate.buildArea[n] = -1.0f;
+        markWideDirty(n);
+    }
+}
+
+// 把新子树挂到树中：从根向下，每层进入包围盒增长最小的内部子节点，
+// 遇到空位直接挂入；子树比该子节点大或该子节点是叶子时，新建一个节点同时容纳原子节点和新子树
+void attachWideSubtree(int subtree) {
+    BVHUpdateState& st = bvhUpdate;
+    float lo[3] = {INFINITY, INFINITY, INFINITY}, hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (int c = 0; c < 4; c++) {
+        for (int axis = 0; axis < 3; axis++) {
+            lo[axis] = min(lo[axis], wideNodes[subtree].bmin[axis][c]);
+            hi[axis] = max(hi[axis], wideNodes[subtree].bmax[axis][c]);
+        }
+    }
+    double area = wideNodeArea(subtree);
+    
+    int n = 0;
+    while (true) {
+        WideBVHNode& node = wideNodes[n];
+        int best = -1;
+        double bestGrowth = 1e300, bestArea = 0;
+        for (int c = 0; c < 4; c++) {
+            if (node.child[c] < 0) {
+                node.child[c] = subtree;
+                node.count[c] = 0;
+                for (int axis = 0; axis < 3; axis++) {
+                    node.bmin[axis][c] = lo[axis];
+                    node.bmax[axis][c] = hi[axis];
+                }
+                st.parent[subtree] = n;
+                st.parentSlot[subtree] = c;
+                markWideDirty(n);
+                return;
+            }
+            double dx = node.bmax[0][c] - node.bmin[0][c];
+            double dy = node.bmax[1][c] - node.bmin[1][c];
+            double dz = node.bmax[2][c] - node.bmin[2][c];
+            double childArea = (dx < 0 || dy < 0 || dz < 0) ? 0.0 : 2.0 * (dx * dy + dy * dz + dz * dx);
+            dx = max(hi[0], node.bmax[0][c]) - min(lo[0], node.bmin[0][c]);
+            dy = max(hi[1], node.bmax[1][c]) - min(lo[1], node.bmin[1][c]);
+            dz = max(hi[2], node.bmax[2][c]) - min(lo[2], node.bmin[2][c]);
+            double growth = 2.0 * (dx * dy + dy * dz + dz * dx) - childArea;
+            if (growth < bestGrowth) {
+                bestGrowth = growth;
+                bestArea = childArea;
+                best = c;
+            }
+        }
+        
+        if (node.count[best] == 0 && area < bestArea) {
+            n = node.child[best];
+            continue;
+        }
+        
+        // 新节点：第0个子节点为原子节点，第1个为新子树
+        WideBVHNode pair;
+        for (int c = 0; c < 4; c++) {
+            for (int axis = 0; axis < 3; axis++) {
+                pair.bmin[axis][c] = c == 0 ? node.bmin[axis][best] : (c == 1 ? lo[axis] : INFINITY);
+                pair.bmax[axis][c] = c == 0 ? node.bmax[axis][best] : (c == 1 ? hi[axis] : -INFINITY);
+            }
+            pair.child[c] = -1;
+            pair.count[c] = 0;
+        }
+        pair.child[0] = node.child[best];
+        pair.count[0] = node.count[best];
+        pair.child[1] = subtree;
+        
+        int p = wideNodes.size();
+        node.child[best] = p;
+        node.count[best] = 0;
+        wideNodes.push_back(pair);      // node引用在此之后失效
+        growBVHUpdate();
+        st.parent[p] = n;
+        st.parentSlot[p] = best;
+        if (pair.count[0] > 0) {
+            for (int s = pair.child[0]; s < pair.child[0] + pair.count[0]; s++) st.slotLeaf[s] = p * 4;
+        } else {
+            st.parent[pair.child[0]] = p;
+            st.parentSlot[pair.child[0]] = 0;
+        }
+        st.parent[subtree] = p;
+        st.parentSlot[subtree] = 1;
+        markWideDirty(p);
+        return;
+    }
+}
+
+// 子树中的三角形位置数
+long long countWideSubtree(int root) {
+    long long slots = 0;
+    vector<int> stack(1, root);
+    while (!stack.empty()) {
+        const WideBVHNode& node = wideNodes[stack.back()];
+        stack.pop_back();
+        for (int c = 0; c < 4; c++) {
+            if (node.child[c] < 0) continue;
+            if (node.count[c] > 0) slots += node.count[c];
+            else stack.push_back(node.child[c]);
+        }
+    }
+    return slots;
+}
+
+// 废弃子树：返回其中的三角形编号
+void retireWideSubtree(int root, vector<int>& ids) {
+    BVHUpdateState& st = bvhUpdate;
+    vector<int> stack(1, root);
+    while (!stack.empty()) {
+        int n = stack.back();
+        stack.pop_back();
+        const WideBVHNode& node = wideNodes[n];
+        for (int c = 0; c < 4; c++) {
+            if (node.child[c] < 0) continue;
+            if (node.count[c] > 0) {
+                for (int s = node.child[c]; s < node.child[c] + node.count[c]; s++) {
+                    ids.push_back(triangleIndices[s]);
+                    st.slotLeaf[s] = -1;
+                }
+                st.deadSlots += node.count[c];
+            } else {
+                stack.push_back(node.child[c]);
+            }
+        }
+        st.parent[n] = -2;
+        st.deadNodes++;
+    }
+}
+
+// 局部重建以n为根的子树（n不是整棵树的根）
+void rebuildWideSubtree(int n) {
+    BVHUpdateState& st = bvhUpdate;
+    int parent = st.parent[n], slot = st.parentSlot[n];
+    int depth = wideNodeDepth(n);
+    vector<int> ids;
+    retireWideSubtree(n, ids);
+    
+    WideBVHNode& p = wideNodes[parent];
+    if (ids.empty()) {
+        p.child[slot] = -1;
+        p.count[slot] = 0;
+        markWideDirty(parent);
+        return;
+    }
+    
+    int first = wideNodes.size();
+    int root = buildWideSubtree(ids, depth);
+    wideNodes[parent].child[slot] = root;
+    wideNodes[parent].count[slot] = 0;
+    st.parent[root] = parent;
+    st.parentSlot[root] = slot;
+    markWideSubtreeDirty(first);
+    bvhUpdateStats.rebuiltSubtrees++;
+    bvhUpdateStats.rebuiltTriangles += ids.size();
+}
+
+// 对[first, first + count)的三角形施加仿射变换m（3x4矩阵，作用于列向量(x, y, z, 1)）
+// 立即更新三角形和热数据，包围盒在下次updateBVH时重新拟合
+void moveTriangles(int first, int count, const double m[3][4]) {
+    initBVHUpdate();
+    int last = min(first + count, triangleCount);
+    #pragma omp parallel for schedule(static) if (last - first > 4096)
+    for (int id = first; id < last; id++) {
+        for (int k = 0; k < 3; k++) {
+            Point3D& p = triangles[id].points[k];
+            double x = p.x, y = p.y, z = p.z;
+            p.x = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3];
+            p.y = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3];
+            p.z = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3];
+        }
+        int slot = triangleSlotOf(id);
+        if (slot >= 0) storeTriangleGeometry(slot);
+    }
+    for (int id = first; id < last; id++) {
+        int slot = triangleSlotOf(id);
+        if (slot >= 0) markWideDirty(bvhUpdate.slotLeaf[slot] >> 2);
+    }
+}
+
+// 显示或隐藏[first, first + count)的三角形（修改BVH后应通过这里而不是直接改appear，隐藏的子树会被剪掉）
+void setTrianglesVisible(int first, int count, bool visible) {
+    initBVHUpdate();
+    int last = min(first + count, triangleCount);
+    for (int id = first; id < last; id++) {
+        if (isTriangleRemoved(id) || appear[id] == visible) continue;
+        appear[id] = visible;
+        int slot = triangleSlotOf(id);
+        if (slot >= 0) markWideDirty(bvhUpdate.slotLeaf[slot] >> 2);
+    }
+}
+
+// 从场景删除[first, first + count)的三角形：编号保留，从所在叶子中移出（与叶子末尾交换后缩短叶子）
+void removeTriangles(int first, int count) {
+    initBVHUpdate();
+    BVHUpdateState& st = bvhUpdate;
+    int last = min(first + count, triangleCount);
+    if ((int)removedTriangles.size() < last) removedTriangles.resize(last, 0);
+    for (int id = first; id < last; id++) {
+        if (removedTriangles[id]) continue;
+        removedTriangles[id] = 1;
+        appear[id] = 0;
+        int slot = triangleSlotOf(id);
+        if (slot < 0) continue;
+        
+        int leaf = st.slotLeaf[slot], n = leaf >> 2, c = leaf & 3;
+        WideBVHNode& node = wideNodes[n];
+        int end = node.child[c] + node.count[c] - 1;
+        swapTriangleSlots(slot, end);
+        st.slotLeaf[end] = -1;
+        st.triangleSlot[id] = -1;
+        st.deadSlots++;
+        if (--node.count[c] == 0) node.child[c] = -1;
+        markWideDirty(n);
+    }
+}
+
+// 把[first, first + count)的三角形加入BVH：用于BVH构建之后新添加的三角形，或重新加入已删除的三角形
+// 下次updateBVH时为它们构建一棵子树并挂入树中
+void insertTriangles(int first, int count) {
+    initBVHUpdate();
+    int last = min(first + count, triangleCount);
+    for (int id = first; id < last; id++) {
+        if (id < (int)meshTriangles.size() && meshTriangles[id]) continue;   // 实例化网格的三角形不进入场景BVH
+        if (isTriangleRemoved(id)) {
+            removedTriangles[id] = 0;
+            appear[id] = 1;
+        }
+        if (triangleSlotOf(id) < 0) bvhUpdate.pendingInserts.push_back(id);
+    }
+}
+
+// 应用之前的修改：插入新三角形，自底向上拟合改动过的节点，表面积增长超过阈值的子树局部重建
+// 修改之间不需要调用，每帧渲染前调用一次即可；耗时与改动的三角形数和它们的祖先节点数成正比
+void updateBVH() {
+    BVHUpdateState& st = bvhUpdate;
+    bvhUpdateStats = BVHUpdateStats();
+    if (!st.valid || (st.dirtyNodes.empty() && st.pendingInserts.empty())) return;
+    auto start = chrono::steady_clock::now();
+    growBVHUpdate();
+    sceneRevision++;
+    
+    // 1. 新三角形单独建一棵子树挂入
+    vector<int> ids;
+    for (size_t i = 0; i < st.pendingInserts.size(); i++) {
+        int id = st.pendingInserts[i];
+        if (!isTriangleRemoved(id) && triangleSlotOf(id) < 0) ids.push_back(id);
+    }
+    sort(ids.begin(), ids.end());
+    ids.erase(unique(ids.begin(), ids.end()), ids.end());
+    st.pendingInserts.clear();
+    bool fullRebuild = wideNodes.empty() && !ids.empty();
+    if (!ids.empty() && !fullRebuild) {
+        int first = wideNodes.size();
+        int subtree = buildWideSubtree(ids, 1);
+        attachWideSubtree(subtree);
+        markWideSubtreeDirty(first);
+        bvhUpdateStats.insertedTriangles = ids.size();
+    }
+    
+    // 2. 拟合；3. 质量下降的子树取最上层的局部重建，之后再拟合一次
+    if (!fullRebuild) {
+        vector<int> degraded = refitDirtyNodes();
+        vector<pair<int, int>> order;
+        for (size_t i = 0; i < degraded.size(); i++) order.push_back(make_pair(wideNodeDepth(degraded[i]), degraded[i]));
+        sort(order.begin(), order.end());
+        
+        // 重建后废弃的位置会超过阈值时直接整棵树重建
+        vector<char> chosen(wideNodes.size(), 0);
+        vector<int> roots;
+        long long retired = st.deadSlots;
+        for (size_t i = 0; i < order.size() && !fullRebuild; i++) {
+            int n = order[i].second;
+            bool covered = false;
+            for (int p = n; p >= 0 && !covered; p = st.parent[p]) covered = chosen[p];
+            if (covered) continue;
+            chosen[n] = 1;
+            roots.push_back(n);
+            retired += countWideSubtree(n);
+            fullRebuild = n == 0 || retired > (long long)(triangleIndices.size() - retired) * bvhUpdateConfig.garbageRatio;
+        }
+        for (size_t i = 0; i < roots.size() && !fullRebuild; i++) rebuildWideSubtree(roots[i]);
+        if (!fullRebuild && !roots.empty()) refitDirtyNodes();
+    }
+    
+    // 4. 废弃数据太多或树太深（超出遍历栈）时整棵树重建
+    long long liveSlots = triangleIndices.size() - st.deadSlots;
+    long long liveNodes = wideNodes.size() - st.deadNodes;
+    if (st.deadSlots > liveSlots * bvhUpdateConfig.garbageRatio ||
+        st.deadNodes > liveNodes * bvhUpdateConfig.garbageRatio ||
+        (!wideNodes.empty() && st.height[0] >= BVH_STACK_SIZE - 1)) {
+        fullRebuild = true;
+    }
+    if (fullRebuild) {
+        initBVH();
+        bvhUpdateStats.fullRebuild = true;
+    }
+    bvhUpdateStats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
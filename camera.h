@@ -0,0 +1,127 @@
+// camera.cpp - 相机帧：每帧预先计算相机坐标系和每行/每列的屏幕坐标，逐行批量生成主光线
+
+#include "vector.h"
+#include <bits/stdc++.h>
+using namespace std;
+
+// 相机帧：只依赖相机位姿、视场角和分辨率，每帧计算一次
+struct CameraFrame {
+    double origin[3];
+    double right[3], up[3], forward[3];     // 相机坐标系（世界坐标）
+    double aspect, tanHalfFov;
+    double pixelSpread;                     // 一个像素对应的视角（主光线锥的扩散角）
+    vector<double> screenX;                 // 第x列像素中心的相机平面x坐标
+    vector<double> screenY;                 // 第y行像素中心的相机平面y坐标
+};
+
+CameraFrame cameraFrame;
+
+// 根据当前相机和分辨率更新相机帧（渲染每帧前调用）
+void updateCameraFrame() {
+    CameraFrame& f = cameraFrame;
+    f.origin[0] = camera.x;
+    f.origin[1] = camera.y;
+    f.origin[2] = camera.z;
+    
+    double aspect = f.aspect = (double)screenWidth / screenHeight;
+    double tanHalfFov = f.tanHalfFov = tan(camera.fov / 2.0);
+    f.pixelSpread = atan(2.0 * tanHalfFov / screenHeight);
+    
+    // 标准化设备坐标
+    f.screenX.resize(screenWidth);
+    for (int x = 0; x < screenWidth; x++) {
+        f.screenX[x] = (2.0 * (x + 0.5) / screenWidth - 1.0) * aspect * tanHalfFov;
+    }
+    f.screenY.resize(screenHeight);
+    for (int y = 0; y < screenHeight; y++) {
+        f.screenY[y] = (1.0 - 2.0 * (screenHeight-y + 0.5) / screenHeight) * tanHalfFov;
+    }
+    
+    // 相机坐标系到世界坐标系的变换
+    f.forward[0] = sin(camera.yaw) * cos(camera.pitch);
+    f.forward[1] = sin(camera.pitch);
+    f.forward[2] = -cos(camera.yaw) * cos(camera.pitch);
+    
+    f.right[0] = cos(camera.yaw);
+    f.right[1] = 0;
+    f.right[2] = sin(camera.yaw);
+    
+    cross(f.forward, f.right, f.up);
+    normalize(f.up);
+    
+    cross(f.up, f.forward, f.right);
+    normalize(f.right);
+}
+
+// 两个相机位姿（位置、朝向和视场角）是否相同
+bool sameCameraPose(const Camera& a, const Camera& b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z &&
+           a.yaw == b.yaw && a.pitch == b.pitch && a.fov == b.fov;
+}
+
+// 把世界坐标点投影到本帧屏幕：返回连续像素坐标(x, y)（整数坐标即generateRay的采样位置）和沿视线的深度
+// 点在相机后方时返回false
+bool projectToScreen(const double p[3], double& x, double& y, double& depth) {
+    CameraFrame& f = cameraFrame;
+    double d[3] = {p[0] - f.origin[0], p[1] - f.origin[1], p[2] - f.origin[2]};
+    depth = -dot(d, f.forward);    // 光线方向为 sx*right + sy*up - forward
+    if (depth <= 1e-6) return false;
+    
+    double screenX = dot(d, f.right) / depth;
+    double screenY = dot(d, f.up) / depth;
+    x = (screenX / (f.aspect * f.tanHalfFov) + 1.0) * screenWidth / 2.0 - 0.5;
+    y = screenHeight + 0.5 - (1.0 - screenY / f.tanHalfFov) * screenHeight / 2.0;
+    return true;
+}
+
+// 由相机平面坐标生成世界空间光线方向
+inline void cameraRayDirection(const CameraFrame& f, double screenX, double screenY, double out[3]) {
+    double dir[3] = {screenX, screenY, -1.0};
+    normalize(dir);
+    
+    out[0] = dir[0] * f.right[0] + dir[1] * f.up[0] + dir[2] * f.forward[0];
+    out[1] = dir[0] * f.right[1] + dir[1] * f.up[1] + dir[2] * f.forward[1];
+    out[2] = dir[0] * f.right[2] + dir[1] * f.up[2] + dir[2] * f.forward[2];
+    normalize(out);
+}
+
+// 生成相机光线（透视投影），使用本帧的相机帧
+Ray generateRay(int x, int y) {
+    Ray ray;
+    ray.origin[0] = cameraFrame.origin[0];
+    ray.origin[1] = cameraFrame.origin[1];
+    ray.origin[2] = cameraFrame.origin[2];
+    cameraRayDirection(cameraFrame, cameraFrame.screenX[x], cameraFrame.screenY[y], ray.direction);
+    ray.coneSpread = cameraFrame.pixelSpread;
+    return ray;
+}
+
+// 生成像素内偏移(dx, dy)处的光线（dx, dy在[-0.5, 0.5)内，用于超采样抗锯齿）
+Ray generateRayOffset(int x, int y, double dx, double dy) {
+    const CameraFrame& f = cameraFrame;
+    double screenX = (2.0 * (x + 0.5 + dx) / screenWidth - 1.0) * f.aspect * f.tanHalfFov;
+    double screenY = (1.0 - 2.0 * (screenHeight-y + 0.5 + dy) / screenHeight) * f.tanHalfFov;
+    
+    Ray ray;
+    ray.origin[0] = f.origin[0];
+    ray.origin[1] = f.origin[1];
+    ray.origin[2] = f.origin[2];
+    cameraRayDirection(f, screenX, screenY, ray.direction);
+    ray.coneSpread = f.pixelSpread;
+    return ray;
+}
+
+// 批量生成第y行上x0, x0+step, ...共count条光线（光线包和分块渲染逐行调用）
+void generateRayRow(int x0, int step, int count, int y, Ray* rays) {
+    const CameraFrame& f = cameraFrame;
+    double screenY = f.screenY[y];
+    for (int k = 0; k < count; k++) {
+        Ray& ray = rays[k];
+        ray.origin[0] = f.origin[0];
+        ray.origin[1] = f.origin[1];
+        ray.origin[2] = f.origin[2];
+        cameraRayDirection(f, f.screenX[x0 + k * step], screenY, ray.direction);
+        ray.coneWidth = 0;
+        ray.coneSpread = f.pixelSpread;
+    }
+}
@@ -0,0 +1,633 @@
+// headless.cpp - 无窗口离线渲染：帧缓冲写入PPM/PNG文件，用于批量渲染和性能计时
+
+#include <bits/stdc++.h>
+#include "vector.h"
+#include <omp.h>
+#ifndef _WIN32
+#include <png.h>
+#endif
+using namespace std;
+
+// 离线渲染参数
+struct HeadlessOptions {
+    int width = WIDTH, height = HEIGHT;     // 输出分辨率
+    int step = 1;                           // 每step×step像素追踪一条光线
+    int repeat = 1;                         // 每个相机位姿重复渲染次数（计时用）
+    string outPattern = "frame_%04d.ppm";   // 输出文件名模式
+    string objFile = "dagon/dagon.obj";
+    string textureFile = "dagon/dagon.png";
+    vector<Camera> poses;                   // 相机位姿列表，每个位姿输出一帧
+    bool benchPrimary = false;              // 只测主光线求交吞吐量（逐条光线与光线包对比）
+    bool threadStats = false;               // 每帧打印各线程利用率
+    bool textureStats = false;              // 每帧打印纹理命中、解码和淘汰次数
+    double animate = 0;                     // 每帧把模型绕竖直轴旋转的角度（度），BVH增量更新
+    int instances = 0;                      // 在模型后方按网格摆放N个实例（模型作为网格只加载一次）
+    int progressiveFrames = 0;              // >0时每个位姿用渐进式渲染N帧（相机静止，逐帧累积）
+    double lightRadius = -1;                // 覆盖场景光源半径（>0时产生软阴影），负数表示不覆盖
+    int extraLights = 0;                    // 在地面上方随机散布的额外点光源数
+    bool reproject = false;                 // 位姿按相机路径连续渲染，复用上一帧重投影的着色
+};
+
+// 打印命令行用法
+void printHeadlessUsage(const char* program) {
+    cout << "用法: " << program << " [--headless] [选项]" << endl
+         << "  --width N --height N       输出分辨率（默认" << WIDTH << "x" << HEIGHT << "）" << endl
+         << "  --step N                   每N×N像素追踪一条光线（默认1）" << endl
+         << "  --fov degrees              垂直视场角（默认60）" << endl
+         << "  --camera x,y,z,yaw,pitch   相机位姿，可重复指定，每个位姿输出一帧" << endl
+         << "  --cameras file             从文件读取相机位姿（每行 x y z yaw pitch）" << endl
+         << "  --repeat N                 每个位姿重复渲染N次，取平均耗时" << endl
+         << "  --out pattern              输出文件名，恰好含一个 %d 或 %0Nd 作为帧号，如 frame_%04d.png（默认 frame_%04d.ppm）" << endl
+         << "  --leaf-size N              BVH叶子最多三角形数（默认" << bvhConfig.maxLeafSize << "）" << endl
+         << "  --traversal-cost X         SAH遍历代价/三角形测试代价（默认" << bvhConfig.traversalCost << "）" << endl
+         << "  --simd auto|scalar|sse|avx2 求交内核指令集（默认auto，超出CPU支持时自动降级）" << endl
+         << "  --packet on|off            主光线按8x8光线包遍历（默认on）" << endl
+         << "  --sampler random|sobol     软阴影光源采样序列（默认random，均按像素和帧号确定，可重现）" << endl
+         << "  --light-radius R           把场景光源半径设为R（R>0时渲染软阴影）" << endl
+         << "  --lights N                 在地面上方散布N个额外的彩色点光源" << endl
+         << "  --light-samples N          光源多于N个时每个着色点按光源BVH重要性采样N个光源（默认" << lightSampleCount << "）" << endl
+         << "  --progressive N            渐进式渲染：每个位姿连续渲染N帧并累积采样，输出最后一帧" << endl
+         << "  --reproject                位姿视为连续相机路径，每帧复用上一帧重投影的着色，只追踪空洞和轮换刷新的采样" << endl
+         << "  --thread-stats             每帧打印各线程渲染的块数、窃取次数和利用率" << endl
+         << "  --animate degrees          从第二帧起每帧把模型绕竖直轴旋转指定角度，增量更新BVH并打印更新耗时" << endl
+         << "  --instances N              模型作为网格再加载一次，在模型后方摆放N个实例（部分实例覆盖颜色或材质）" << endl
+         << "  --bench-primary            只测主光线求交吞吐量，对比逐条光线和光线包，不输出图像" << endl
+         << "  --obj file --texture file  场景模型和纹理（默认 dagon/dagon.obj, dagon/dagon.png）" << endl
+         << "  --texture-layout linear|tiled 纹理存储布局：按行或4x4分块Morton顺序（默认tiled）" << endl
+         << "  --texture-filter nearest|bilinear|trilinear 纹理过滤方式（默认trilinear）" << endl
+         << "  --mipmap on|off            按光线锥足迹选择纹理mip级别（默认on）" << endl
+         << "  --texture-budget MB        常驻纹理的内存预算，超出时淘汰最久未采样的纹理（默认" << (textureBudget >> 20) << "）" << endl
+         << "  --texture-stats            每帧打印纹理命中、解码和淘汰次数" << endl
+         << "  --scene-cache on|off       从模型旁的 .scene 缓存加载场景和BVH，源文件变化时自动重建（默认on）" << endl;
+}
+
+// 解析 "x,y,z,yaw,pitch" 形式的相机位姿（逗号或空格分隔）
+bool parseCameraPose(string text, Camera& pose) {
+    replace(text.begin(), text.end(), ',', ' ');
+    istringstream iss(text);
+    return (bool)(iss >> pose.x >> pose.y >> pose.z >> pose.yaw >> pose.pitch);
+}
+
+// 按输出文件名模式生成第frame帧的文件名：模式中必须恰好有一个 %d 或 %0Nd，%% 表示 % 本身
+// 不把模式交给printf，其他转换（如 %s）视为无效模式
+bool formatOutputName(const string& pattern, int frame, string& name) {
+    name.clear();
+    int conversions = 0;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        if (pattern[i] != '%') {
+            name += pattern[i];
+            continue;
+        }
+        if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+            name += '%';
+            i++;
+            continue;
+        }
+        size_t j = i + 1;
+        bool zeroPad = j < pattern.size() && pattern[j] == '0';
+        size_t width = 0;
+        while (j < pattern.size() && isdigit((unsigned char)pattern[j]) && width < 64) {
+            width = width * 10 + (pattern[j++] - '0');
+        }
+        if (j >= pattern.size() || pattern[j] != 'd' || width >= 64) return false;
+        string digits = to_string(frame);
+        if (digits.size() < width) digits.insert(0, width - digits.size(), zeroPad ? '0' : ' ');
+        name += digits;
+        conversions++;
+        i = j;
+    }
+    return conversions == 1;
+}
+
+// 解析命令行参数
+bool parseHeadlessOptions(int argc, char** argv, HeadlessOptions& opt) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        
+        if (arg == "--headless") {
+            continue;
+        } else if (arg == "--width" && hasValue) {
+            opt.width = atoi(argv[++i]);
+        } else if (arg == "--height" && hasValue) {
+            opt.height = atoi(argv[++i]);
+        } else if (arg == "--fov" && hasValue) {
+            camera.fov = atof(argv[++i]) * PI / 180.0;
+        } else if (arg == "--step" && hasValue) {
+            opt.step = atoi(argv[++i]);
+        } else if (arg == "--repeat" && hasValue) {
+            opt.repeat = atoi(argv[++i]);
+        } else if (arg == "--out" && hasValue) {
+            opt.outPattern = argv[++i];
+            string name;
+            if (!formatOutputName(opt.outPattern, 0, name)) {
+                cout << "Invalid output pattern (needs exactly one %d or %0Nd): " << opt.outPattern << endl;
+                return false;
+            }
+        } else if (arg == "--leaf-size" && hasValue) {
+            bvhConfig.maxLeafSize = atoi(argv[++i]);
+        } else if (arg == "--traversal-cost" && hasValue) {
+            bvhConfig.traversalCost = atof(argv[++i]);
+        } else if (arg == "--simd" && hasValue) {
+            string level = argv[++i];
+            if (level == "auto") simdLevel = -1;
+            else if (level == "scalar") simdLevel = SIMD_SCALAR;
+            else if (level == "sse") simdLevel = SIMD_SSE;
+            else if (level == "avx2") simdLevel = SIMD_AVX2;
+            else return false;
+        } else if (arg == "--packet" && hasValue) {
+            string mode = argv[++i];
+            if (mode != "on" && mode != "off") return false;
+            packetTracing = mode == "on";
+        } else if (arg == "--texture-layout" && hasValue) {
+            string mode = argv[++i];
+            if (mode == "linear") textureLayout = TEXTURE_LINEAR;
+            else if (mode == "tiled") textureLayout = TEXTURE_TILED;
+            else return false;
+        } else if (arg == "--texture-filter" && hasValue) {
+            string mode = argv[++i];
+            if (mode == "nearest") textureFilter = TEXTURE_FILTER_NEAREST;
+            else if (mode == "bilinear") textureFilter = TEXTURE_FILTER_BILINEAR;
+            else if (mode == "trilinear") textureFilter = TEXTURE_FILTER_TRILINEAR;
+            else return false;
+        } else if (arg == "--mipmap" && hasValue) {
+            string mode = argv[++i];
+            if (mode != "on" && mode != "off") return false;
+            textureMipmaps = mode == "on";
+        } else if (arg == "--texture-budget" && hasValue) {
+            double mb = atof(argv[++i]);
+            if (mb <= 0) return false;
+            textureBudget = (size_t)(mb * (1 << 20));
+        } else if (arg == "--texture-stats") {
+            opt.textureStats = true;
+        } else if (arg == "--scene-cache" && hasValue) {
+            string mode = argv[++i];
+            if (mode != "on" && mode != "off") return false;
+            sceneCacheEnabled = mode == "on";
+        } else if (arg == "--sampler" && hasValue) {
+            string mode = argv[++i];
+            if (mode == "random") lightSampler = SAMPLER_RANDOM;
+            else if (mode == "sobol") lightSampler = SAMPLER_SOBOL;
+            else return false;
+        } else if (arg == "--light-radius" && hasValue) {
+            opt.lightRadius = atof(argv[++i]);
+        } else if (arg == "--lights" && hasValue) {
+            opt.extraLights = atoi(argv[++i]);
+        } else if (arg == "--light-samples" && hasValue) {
+            lightSampleCount = atoi(argv[++i]);
+            if (lightSampleCount <= 0) return false;
+        } else if (arg == "--progressive" && hasValue) {
+            opt.progressiveFrames = atoi(argv[++i]);
+        } else if (arg == "--reproject") {
+            opt.reproject = true;
+        } else if (arg == "--animate" && hasValue) {
+            opt.animate = atof(argv[++i]);
+        } else if (arg == "--instances" && hasValue) {
+            opt.instances = atoi(argv[++i]);
+        } else if (arg == "--thread-stats") {
+            opt.threadStats = true;
+        } else if (arg == "--bench-primary") {
+            opt.benchPrimary = true;
+        } else if (arg == "--obj" && hasValue) {
+            opt.objFile = argv[++i];
+        } else if (arg == "--texture" && hasValue) {
+            opt.textureFile = argv[++i];
+        } else if (arg == "--camera" && hasValue) {
+            Camera pose;
+            if (!parseCameraPose(argv[++i], pose)) {
+                cout << "Invalid camera pose: " << argv[i] << endl;
+                return false;
+            }
+            opt.poses.push_back(pose);
+        } else if (arg == "--cameras" && hasValue) {
+            ifstream file(argv[++i]);
+            if (!file.is_open()) {
+                cout << "Failed to open camera file: " << argv[i] << endl;
+                return false;
+            }
+            string line;
+            while (getline(file, line)) {
+                if (line.empty() || line[0] == '#') continue;
+                Camera pose;
+                if (parseCameraPose(line, pose)) opt.poses.push_back(pose);
+            }
+        } else {
+            return false;
+        }
+    }
+    
+    if (opt.width <= 0 || opt.height <= 0 || opt.step <= 0 || opt.repeat <= 0 ||
+        opt.progressiveFrames < 0 || bvhConfig.maxLeafSize <= 0 || bvhConfig.traversalCost <= 0 || camera.fov <= 0 || camera.fov >= PI) {
+        return false;
+    }
+    
+    // 未指定位姿时使用默认相机
+    if (opt.poses.empty()) opt.poses.push_back(Camera());
+    return true;
+}
+
+// 写入二进制PPM（P6）
+bool savePPM(const string& filename) {
+    ofstream file(filename, ios::binary);
+    if (!file.is_open()) return false;
+    
+    file << "P6\n" << screenWidth << " " << screenHeight << "\n255\n";
+    vector<unsigned char> row(screenWidth * 3);
+    for (int y = 0; y < screenHeight; y++) {
+        for (int x = 0; x < screenWidth; x++) {
+            COLORREF c = flash_screen[y * screenWidth + x];
+            row[x * 3 + 0] = GetRValue(c);
+            row[x * 3 + 1] = GetGValue(c);
+            row[x * 3 + 2] = GetBValue(c);
+        }
+        file.write((const char*)row.data(), row.size());
+    }
+    return file.good();
+}
+
+#ifdef _WIN32
+// 查找GDI+图像编码器
+bool getEncoderClsid(const wchar_t* format, CLSID& clsid) {
+    UINT num = 0, size = 0;
+    GetImageEncodersSize(&num, &size);
+    if (size == 0) return false;
+    
+    vector<BYTE> buffer(size);
+    ImageCodecInfo* codecs = (ImageCodecInfo*)buffer.data();
+    GetImageEncoders(num, size, codecs);
+    for (UINT i = 0; i < num; i++) {
+        if (wcscmp(codecs[i].MimeType, format) == 0) {
+            clsid = codecs[i].Clsid;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 写入PNG（使用GDI+）
+bool savePNG(const string& filename) {
+    startupGdiplus();
+    CLSID clsid;
+    if (!getEncoderClsid(L"image/png", clsid)) return false;
+    
+    Bitmap bitmap(screenWidth, screenHeight, PixelFormat24bppRGB);
+    for (int y = 0; y < screenHeight; y++) {
+        for (int x = 0; x < screenWidth; x++) {
+            COLORREF c = flash_screen[y * screenWidth + x];
+            bitmap.SetPixel(x, y, Color(GetRValue(c), GetGValue(c), GetBValue(c)));
+        }
+    }
+    return bitmap.Save(MultiByteToWide(filename).c_str(), &clsid, NULL) == Ok;
+}
+#else
+// 写入PNG（使用libpng）
+bool savePNG(const string& filename) {
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (fp == NULL) return false;
+    
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if (png == NULL || info == NULL || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        fclose(fp);
+        return false;
+    }
+    
+    png_init_io(png, fp);
+    png_set_IHDR(png, info, screenWidth, screenHeight, 8, PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    
+    vector<png_byte> row(screenWidth * 3);
+    for (int y = 0; y < screenHeight; y++) {
+        for (int x = 0; x < screenWidth; x++) {
+            COLORREF c = flash_screen[y * screenWidth + x];
+            row[x * 3 + 0] = GetRValue(c);
+            row[x * 3 + 1] = GetGValue(c);
+            row[x * 3 + 2] = GetBValue(c);
+        }
+        png_write_row(png, row.data());
+    }
+    
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+    fclose(fp);
+    return true;
+}
+#endif
+
+// 根据扩展名保存帧缓冲
+bool saveFrame(const string& filename) {
+    string ext = filename.size() >= 4 ? filename.substr(filename.size() - 4) : "";
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".png" ? savePNG(filename) : savePPM(filename);
+}
+
+// 动画一帧：带纹理的三角形（加载的模型）绕经过其包围盒中心的竖直轴旋转degrees度，再增量更新BVH
+void animateModel(double degrees) {
+    static int first = -1, last = -1;
+    static double center[3];
+    if (first < 0) {
+        AABB box;
+        for (int i = 0; i < triangleCount; i++) {
+            if (triangles[i].textureId < 0 || (i < (int)meshTriangles.size() && meshTriangles[i])) continue;
+            if (first < 0) first = i;
+            last = i + 1;
+            box = mergeAABB(box, computeTriangleAABB(triangles[i]));
+        }
+        if (first < 0) first = last = 0;
+        for (int k = 0; k < 3; k++) center[k] = (box.min[k] + box.max[k]) * 0.5;
+    }
+    
+    double a = degrees * PI / 180.0, c = cos(a), s = sin(a);
+    double m[3][4] = {
+        {c, 0, s, center[0] - c * center[0] - s * center[2]},
+        {0, 1, 0, 0},
+        {-s, 0, c, center[2] + s * center[0] - c * center[2]}
+    };
+    moveTriangles(first, last - first, m);
+    updateBVH();
+    
+    // 实例各自绕经过自身中心的竖直轴旋转：只改变换，不触及网格的三角形
+    for (int id = 0; id < (int)instances.size(); id++) {
+        const Instance& inst = instances[id];
+        const AABB& box = meshes[inst.mesh].bounds;
+        double local[3] = {(box.min[0] + box.max[0]) * 0.5, (box.min[1] + box.max[1]) * 0.5, (box.min[2] + box.max[2]) * 0.5};
+        double p[3];
+        transformPoint(inst.transform, local, p);
+        double rotate[3][4] = {
+            {c, 0, s, p[0] - c * p[0] - s * p[2]},
+            {0, 1, 0, 0},
+            {-s, 0, c, p[2] + s * p[0] - c * p[2]}
+        };
+        double next[3][4];
+        for (int r = 0; r < 3; r++) {
+            for (int k = 0; k < 4; k++) {
+                next[r][k] = rotate[r][0] * inst.transform[0][k] + rotate[r][1] * inst.transform[1][k] +
+                             rotate[r][2] * inst.transform[2][k] + (k == 3 ? rotate[r][3] : 0.0);
+            }
+        }
+        setInstanceTransform(id, next);
+    }
+}
+
+// 把模型作为网格再加载一次，在它后方（离原点更远的+z方向）按网格摆放count个实例
+// 每4个实例中一个覆盖为单色，一个覆盖为镜面材质
+bool placeModelInstances(const HeadlessOptions& opt, int count) {
+    int mesh = loadMesh(opt.objFile.c_str(), opt.textureFile.c_str());
+    if (mesh < 0) return false;
+    
+    const AABB& box = meshes[mesh].bounds;
+    double spacing = 1.2 * max(box.max[0] - box.min[0], box.max[2] - box.min[2]);
+    int columns = (int)ceil(sqrt((double)count));
+    const int palette[4] = {RGB(220, 80, 60), RGB(80, 180, 90), RGB(70, 110, 220), RGB(230, 200, 60)};
+    for (int i = 0; i < count; i++) {
+        int row = i / columns, column = i % columns;
+        double m[3][4] = {
+            {1, 0, 0, (column - (columns - 1) * 0.5) * spacing},
+            {0, 1, 0, 0},
+            {0, 0, 1, (row + 1) * spacing}
+        };
+        int materialType = i % 4 == 3 ? 3 : -1;
+        int color = i % 4 == 1 ? palette[(i / 4) % 4] : -1;
+        addInstance(mesh, m, materialType, color);
+    }
+    updateInstances();
+    cout << "实例: " << count << " 个（网格三角形 " << meshes[mesh].triangleCount << "），顶层BVH "
+         << instanceStats.tlasNodes << " 个节点，构建 " << instanceStats.ms << " ms" << endl;
+    return true;
+}
+
+// 在地面上方散布count个彩色点光源（位置和颜色由编号哈希得到，每次运行相同）
+void scatterLights(int count) {
+    for (int i = 0; i < count; i++) {
+        unsigned long long h = mixBits(i + 0x51ed2701ULL);
+        auto next = [&h]() { h = mixBits(h); return (h >> 11) * (1.0 / 9007199254740992.0); };
+        double x = -90 + 180 * next(), y = -8 + 28 * next(), z = -90 + 180 * next();
+        double r = 0.3 + 0.7 * next(), g = 0.3 + 0.7 * next(), b = 0.3 + 0.7 * next();
+        addPointLight(x, y, z, r, g, b, 4.0, 0);
+    }
+}
+
+// 汇总并清零各线程的光线计数
+long long collectRayCount() {
+    long long total = 0;
+    #pragma omp parallel reduction(+:total)
+    {
+        total += threadRayCount;
+        threadRayCount = 0;
+    }
+    return total;
+}
+
+// 主光线求交一遍（不着色），返回耗时；hits按采样点顺序保存结果用于比对
+double tracePrimaryRays(int step, bool packet, vector<HitRecord>& hits) {
+    updateCameraFrame();
+    int cols = (screenWidth + step - 1) / step;
+    int rows = (screenHeight + step - 1) / step;
+    hits.assign(cols * rows, HitRecord());
+    auto start = chrono::steady_clock::now();
+    
+    if (packet) {
+        int tilesX = (cols + PACKET_SIZE - 1) / PACKET_SIZE;
+        int tilesY = (rows + PACKET_SIZE - 1) / PACKET_SIZE;
+        #pragma omp parallel for schedule(dynamic)
+        for (int tile = 0; tile < tilesX * tilesY; tile++) {
+            int c0 = tile % tilesX * PACKET_SIZE, r0 = tile / tilesX * PACKET_SIZE;
+            Ray rays[MAX_PACKET_RAYS];
+            HitRecord tileHits[MAX_PACKET_RAYS];
+            int count = 0;
+            int columns = min(c0 + PACKET_SIZE, cols) - c0;
+            for (int r = r0; r < min(r0 + PACKET_SIZE, rows); r++) {
+                generateRayRow(c0 * step, step, columns, r * step, rays + count);
+                count += columns;
+            }
+            intersectPacket(rays, tileHits, count);
+            int k = 0;
+            for (int r = r0; r < min(r0 + PACKET_SIZE, rows); r++) {
+                for (int c = c0; c < min(c0 + PACKET_SIZE, cols); c++) {
+                    hits[r * cols + c] = tileHits[k++];
+                }
+            }
+        }
+    } else {
+        #pragma omp parallel for schedule(dynamic)
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                HitRecord& hit = hits[r * cols + c];
+                hit.t = 1e9;
+                hit.hit = false;
+                hit.instance = -1;
+                Ray ray = generateRay(c * step, r * step);
+                intersectBVH(ray, hit);
+                if (!instances.empty()) intersectInstances(ray, hit);
+            }
+        }
+    }
+    
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// 主光线吞吐量测试：每个位姿分别用逐条光线和光线包遍历，取repeat次中的最短耗时
+void benchmarkPrimaryRays(const HeadlessOptions& opt) {
+    for (size_t frame = 0; frame < opt.poses.size(); frame++) {
+        const Camera& pose = opt.poses[frame];
+        camera.x = pose.x; camera.y = pose.y; camera.z = pose.z;
+        camera.yaw = pose.yaw; camera.pitch = pose.pitch;
+        
+        vector<HitRecord> singleHits, packetHits;
+        double singleMs = 1e30, packetMs = 1e30;
+        for (int r = 0; r < opt.repeat; r++) {
+            singleMs = min(singleMs, tracePrimaryRays(opt.step, false, singleHits));
+            packetMs = min(packetMs, tracePrimaryRays(opt.step, true, packetHits));
+        }
+        
+        int mismatch = 0;
+        for (size_t i = 0; i < singleHits.size(); i++) {
+            if (singleHits[i].hit != packetHits[i].hit ||
+                (singleHits[i].hit && (singleHits[i].prim != packetHits[i].prim ||
+                                       singleHits[i].instance != packetHits[i].instance))) mismatch++;
+        }
+        double rays = singleHits.size();
+        cout << "Frame " << frame << ": " << (long long)rays << " primary rays, single "
+             << singleMs << " ms (" << rays / singleMs / 1000.0 << " Mrays/s), packet "
+             << packetMs << " ms (" << rays / packetMs / 1000.0 << " Mrays/s), speedup "
+             << singleMs / packetMs << "x, mismatches " << mismatch << endl;
+    }
+}
+
+// 从空的累积缓冲开始连续渲染N帧渐进式画面，verbose时打印每帧的细化情况
+void renderProgressiveFrames(int frames, bool verbose) {
+    resetProgressive();
+    for (int i = 0; i < frames; i++) {
+        auto start = chrono::steady_clock::now();
+        renderProgressive();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if (verbose) {
+            cout << "  渐进帧 " << i << ": " << ms << " ms，采样 " << progressiveStats.samples
+                 << "，细化 " << progressiveStats.tiles << " 块，已收敛 " << progressiveStats.converged
+                 << "/" << tileLevel.size() << " 块，最大误差 " << progressiveStats.maxError << endl;
+        }
+    }
+}
+
+// 离线渲染入口：按相机位姿逐帧渲染并写入文件
+int runHeadless(int argc, char** argv) {
+    HeadlessOptions opt;
+    if (!parseHeadlessOptions(argc, argv, opt)) {
+        printHeadlessUsage(argv[0]);
+        return 1;
+    }
+    
+    screenWidth = opt.width;
+    screenHeight = opt.height;
+    flash_screen.assign(screenWidth * screenHeight, RGB(0, 0, 0));
+    
+    auto loadStart = chrono::steady_clock::now();
+    if (!setupScene(opt.objFile.c_str(), opt.textureFile.c_str())) {
+        cout << "Failed to set up scene" << endl;
+        return 1;
+    }
+    double loadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - loadStart).count();
+    scatterLights(opt.extraLights);
+    if (opt.lightRadius >= 0) {
+        for (size_t i = 0; i < pointLights.size(); i++) pointLights[i].radius = opt.lightRadius;
+    }
+    updateLightBVH();
+    cout << "场景准备耗时: " << loadMs << " ms" << endl;
+    if (opt.extraLights > 0) {
+        cout << "光源: " << pointLights.size() << " 个，光源BVH " << lightBVHStats.nodes << " 个节点，构建 "
+             << lightBVHStats.ms << " ms，每个着色点采样 " << min((int)pointLights.size(), lightSampleCount) << " 个" << endl;
+    }
+    if (opt.instances > 0 && !placeModelInstances(opt, opt.instances)) {
+        cout << "Failed to place instances" << endl;
+        return 1;
+    }
+    
+    if (opt.benchPrimary) {
+        benchmarkPrimaryRays(opt);
+        releaseBVH();
+        releaseInstances();
+        releaseLightBVH();
+        releaseTextures();
+        releaseScene();
+        return 0;
+    }
+    
+    double totalMs = 0;
+    long long totalRays = 0;
+    collectRayCount();
+    collectTextureStats();
+    
+    for (size_t frame = 0; frame < opt.poses.size(); frame++) {
+        const Camera& pose = opt.poses[frame];
+        camera.x = pose.x; camera.y = pose.y; camera.z = pose.z;
+        camera.yaw = pose.yaw; camera.pitch = pose.pitch;
+        
+        if (opt.animate != 0 && frame > 0) {
+            animateModel(opt.animate);
+            cout << "  BVH更新: " << bvhUpdateStats.ms << " ms，拟合 " << bvhUpdateStats.refitNodes << " 个节点，局部重建 "
+                 << bvhUpdateStats.rebuiltSubtrees << " 棵子树（" << bvhUpdateStats.rebuiltTriangles << " 个三角形）"
+                 << (bvhUpdateStats.fullRebuild ? "，整棵树重建" : "") << endl;
+        }
+        updateInstances();
+        updateLightBVH();
+        if (opt.animate != 0 && frame > 0 && !instances.empty()) {
+            cout << "  实例更新: 顶层BVH " << instanceStats.tlasNodes << " 个节点（" << instanceStats.instances
+                 << " 个实例），重建 " << instanceStats.ms << " ms" << endl;
+        }
+        
+        // 随机数按帧号播种：同一位姿的重复渲染结果相同
+        sampleFrame = frame;
+        double frameMs = 0;
+        long long frameRays = 0;
+        vector<ReprojectSample> previousCache = reprojectCache;
+        unsigned int previousFrame = reprojectFrame;
+        for (int r = 0; r < opt.repeat; r++) {
+            if (opt.reproject) {
+                // 重复渲染都从上一位姿的缓存开始
+                reprojectCache = previousCache;
+                reprojectFrame = previousFrame;
+            }
+            auto start = chrono::steady_clock::now();
+            if (opt.progressiveFrames > 0) renderProgressiveFrames(opt.progressiveFrames, r == 0);
+            else if (opt.reproject) renderReprojected(opt.step);
+            else renderFrame(opt.step);
+            frameMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            frameRays += collectRayCount();
+        }
+        totalMs += frameMs;
+        totalRays += frameRays;
+        
+        string filename;
+        formatOutputName(opt.outPattern, (int)frame, filename);
+        bool saved = saveFrame(filename);
+        
+        cout << "Frame " << frame << ": " << frameMs / opt.repeat << " ms, "
+             << frameRays / opt.repeat << " rays, "
+             << (frameMs > 0 ? frameRays / (frameMs / 1000.0) / 1e6 : 0) << " Mrays/s -> "
+             << filename << (saved ? "" : " (write failed)") << endl;
+        if (opt.reproject) {
+            int samples = reprojectStats.reused + reprojectStats.traced;
+            cout << "  重投影: 复用 " << reprojectStats.reused << "/" << samples << " 个采样点 ("
+                 << 100.0 * reprojectStats.reused / samples << "%)，追踪 " << reprojectStats.traced
+                 << "（其中轮换刷新 " << reprojectStats.refreshed << "）" << endl;
+        }
+        if (opt.textureStats) {
+            TextureStats stats = collectTextureStats();
+            cout << "  纹理: 命中 " << stats.hits << "，解码 " << stats.misses << "，淘汰 " << stats.evictions
+                 << "，常驻 " << stats.residentBytes / 1048576.0 << " MB / 预算 " << textureBudget / 1048576.0 << " MB" << endl;
+        }
+        if (opt.threadStats) printRenderThreadStats();
+    }
+    
+    cout << "Total: " << opt.poses.size() << " frames, " << totalMs << " ms, "
+         << (totalMs > 0 ? totalRays / (totalMs / 1000.0) / 1e6 : 0) << " Mrays/s" << endl;
+    
+    releaseBVH();
+    releaseInstances();
+    releaseLightBVH();
+    releaseTextures();
+    releaseScene();
+    return 0;
+}
@@ -0,0 +1,395 @@
+// instance.cpp - 网格实例化（两级BVH）：每个网格只加载一次并在物体空间建一棵底层BVH，实例只带变换和材质覆盖，顶层BVH按实例包围盒重建
+
+#include "vector.h"
+#include <bits/stdc++.h>
+using namespace std;
+
+const int TLAS_LEAF_SIZE = 2;       // 顶层BVH叶子中的实例数上限
+
+// 实例化网格：三角形在triangles中只存一份（物体空间坐标），底层BVH建好后不再改动
+struct Mesh {
+    int firstTriangle = 0;          // 三角形编号范围[firstTriangle, firstTriangle + triangleCount)
+    int triangleCount = 0;
+    WideBVH bvh;                    // 底层BVH
+    AABB bounds;                    // 物体空间包围盒
+};
+
+// 网格实例：transform把物体空间的点映射到世界空间（3x4矩阵，作用于列向量(x, y, z, 1)）
+struct Instance {
+    int mesh = -1;
+    double transform[3][4];
+    double inverse[3][4];           // 世界空间到物体空间
+    int materialType = -1;          // 覆盖材质类型，-1表示沿用三角形自己的材质
+    int color = -1;                 // 覆盖颜色（同时不再采样纹理），-1表示不覆盖
+    bool visible = true;
+    AABB bounds;                    // 世界空间包围盒
+};
+
+// 最近一次updateInstances的统计
+struct InstanceStats {
+    int instances = 0;              // 进入顶层BVH的实例数
+    int tlasNodes = 0;
+    double ms = 0;
+};
+
+vector<Mesh> meshes;
+vector<Instance> instances;
+vector<LinearBVHNode> tlasNodes;    // 顶层BVH（深度优先顺序，叶子的offset为tlasOrder下标）
+vector<int> tlasOrder;              // 按叶子顺序排列的实例编号
+bool tlasDirty = false;             // 实例变换、可见性或材质改过，下次updateInstances时重建顶层BVH
+InstanceStats instanceStats;
+
+// 仿射变换作用于点和向量
+inline void transformPoint(const double m[3][4], const double p[3], double out[3]) {
+    for (int r = 0; r < 3; r++) out[r] = m[r][0] * p[0] + m[r][1] * p[1] + m[r][2] * p[2] + m[r][3];
+}
+inline void transformVector(const double m[3][4], const double v[3], double out[3]) {
+    for (int r = 0; r < 3; r++) out[r] = m[r][0] * v[0] + m[r][1] * v[1] + m[r][2] * v[2];
+}
+
+// 仿射变换求逆：线性部分用伴随矩阵求逆，平移部分为 -A^-1 * t
+void invertAffine(const double m[3][4], double out[3][4]) {
+    double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+               - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+               + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    double inv = fabs(det) > 1e-300 ? 1.0 / det : 0.0;
+    out[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv;
+    out[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv;
+    out[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv;
+    out[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inv;
+    out[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv;
+    out[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv;
+    out[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv;
+    out[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv;
+    out[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv;
+    for (int r = 0; r < 3; r++) {
+        out[r][3] = -(out[r][0] * m[0][3] + out[r][1] * m[1][3] + out[r][2] * m[2][3]);
+    }
+}
+
+// 变换后的包围盒：取8个角点变换后的包围盒
+AABB transformAABB(const double m[3][4], const AABB& box) {
+    AABB result;
+    for (int corner = 0; corner < 8; corner++) {
+        double p[3] = {
+            (corner & 1) ? box.max[0] : box.min[0],
+            (corner & 2) ? box.max[1] : box.min[1],
+            (corner & 4) ? box.max[2] : box.min[2]
+        };
+        double q[3];
+        transformPoint(m, p, q);
+        growAABB(result, {q[0], q[1], q[2]});
+    }
+    return result;
+}
+
+// 把[first, first + count)的三角形（物体空间坐标）做成一个网格并构建它的底层BVH，返回网格编号
+// 这些三角形从此只属于网格，不进入场景BVH，因此应在场景BVH构建之后添加（或之后重新initBVH）
+int createMesh(int first, int count) {
+    if (count <= 0) return -1;
+    auto start = chrono::steady_clock::now();
+    if ((int)meshTriangles.size() < first + count) meshTriangles.resize(first + count, 0);
+    for (int id = first; id < first + count; id++) meshTriangles[id] = 1;
+    
+    Mesh mesh;
+    mesh.firstTriangle = first;
+    mesh.triangleCount = count;
+    
+    // 借用全局的构建数组：暂时把场景BVH换出，以0..count-1为临时编号建树
+    swap(sceneBVH, mesh.bvh);
+    triangleIndices.resize(count);
+    primBounds.resize(count);
+    primCentroids.resize(count);
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < count; k++) {
+        triangleIndices[k] = k;
+        primBounds[k] = computeTriangleAABB(triangles[first + k]);
+        primCentroids[k].x = (primBounds[k].min[0] + primBounds[k].max[0]) * 0.5;
+        primCentroids[k].y = (primBounds[k].min[1] + primBounds[k].max[1]) * 0.5;
+        primCentroids[k].z = (primBounds[k].min[2] + primBounds[k].max[2]) * 0.5;
+    }
+    BVHNode* root = resetBVHNodePool(count);
+    #pragma omp parallel
+    #pragma omp single
+    buildBVH(root, 0, count, 0);
+    bvhNodes.assign(root->nodeCount, LinearBVHNode());
+    #pragma omp parallel
+    #pragma omp single
+    flattenBVH(root, 0);
+    for (int k = 0; k < count; k++) triangleIndices[k] += first;
+    buildTriangleGeometry();
+    
+    // 物体空间中的光线原点可能离网格很远，float舍入误差更大，包围盒比场景BVH多外扩一些
+    float magnitude = 1.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        magnitude = max(magnitude, fabsf(bvhNodes[0].bmin[axis]));
+        magnitude = max(magnitude, fabsf(bvhNodes[0].bmax[axis]));
+    }
+    collapseBVH(0, magnitude * 1e-5f);
+    mesh.bounds = root->bbox;
+    vector<LinearBVHNode>().swap(bvhNodes);
+    vector<AABB>().swap(primBounds);
+    vector<Point3D>().swap(primCentroids);
+    swap(sceneBVH, mesh.bvh);
+    
+    int id = meshes.size();
+    meshes.push_back(move(mesh));
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "网格 " << id << "：三角形 " << count << "，四叉节点 " << meshes[id].bvh.nodes.size()
+         << "，底层BVH构建 " << ms << " ms" << endl;
+    return id;
+}
+
+// 加载带纹理的OBJ模型作为网格（只加载一次，再用addInstance放置任意多个实例），失败返回-1
+int loadMesh(const char* objFile, const char* textureFile) {
+    int first = triangleCount;
+    if (!ProcessModelWithTexture(objFile, MultiByteToWide(textureFile).c_str())) return -1;
+    return createMesh(first, triangleCount - first);
+}
+
+// 设置实例的变换：只重新计算逆变换和世界空间包围盒，不改动网格的三角形和底层BVH
+void setInstanceTransform(int id, const double transform[3][4]) {
+    Instance& inst = instances[id];
+    memcpy(inst.transform, transform, sizeof(inst.transform));
+    invertAffine(inst.transform, inst.inverse);
+    inst.bounds = transformAABB(inst.transform, meshes[inst.mesh].bounds);
+    tlasDirty = true;
+}
+
+// 设置实例的材质覆盖（materialType或color为-1表示沿用三角形自己的）
+void setInstanceMaterial(int id, int materialType, int color) {
+    instances[id].materialType = materialType;
+    instances[id].color = color;
+    tlasDirty = true;
+}
+
+// 显示或隐藏实例（隐藏的实例不进入顶层BVH）
+void setInstanceVisible(int id, bool visible) {
+    if (instances[id].visible == visible) return;
+    instances[id].visible = visible;
+    tlasDirty = true;
+}
+
+// 放置网格的一个实例，返回实例编号
+int addInstance(int mesh, const double transform[3][4], int materialType = -1, int color = -1) {
+    if (mesh < 0 || mesh >= (int)meshes.size()) return -1;
+    int id = instances.size();
+    instances.push_back(Instance());
+    instances[id].mesh = mesh;
+    setInstanceTransform(id, transform);
+    setInstanceMaterial(id, materialType, color);
+    return id;
+}
+
+// 实例的世界空间包围盒中心
+inline double instanceCenter(int id, int axis) {
+    return (instances[id].bounds.min[axis] + instances[id].bounds.max[axis]) * 0.5;
+}
+
+// 构建tlasOrder[start, end)的顶层子树：按包围盒中心在最长轴上取中位数划分，返回节点下标
+int buildTLASNode(int start, int end) {
+    int index = tlasNodes.size();
+    tlasNodes.push_back(LinearBVHNode());
+    
+    AABB box, centers;
+    for (int i = start; i < end; i++) {
+        int id = tlasOrder[i];
+        box = mergeAABB(box, instances[id].bounds);
+        growAABB(centers, {instanceCenter(id, 0), instanceCenter(id, 1), instanceCenter(id, 2)});
+    }
+    LinearBVHNode node;
+    for (int axis = 0; axis < 3; axis++) {
+        node.bmin[axis] = roundDown(box.min[axis]);
+        node.bmax[axis] = roundUp(box.max[axis]);
+    }
+    
+    if (end - start <= TLAS_LEAF_SIZE) {
+        node.offset = start;
+        node.count = end - start;
+        node.axis = 0;
+        tlasNodes[index] = node;
+        return index;
+    }
+    
+    int axis = 0;
+    for (int k = 1; k < 3; k++) {
+        if (centers.max[k] - centers.min[k] > centers.max[axis] - centers.min[axis]) axis = k;
+    }
+    int mid = (start + end) / 2;
+    nth_element(tlasOrder.begin() + start, tlasOrder.begin() + mid, tlasOrder.begin() + end,
+                [axis](int a, int b) { return instanceCenter(a, axis) < instanceCenter(b, axis); });
+    node.count = 0;
+    node.axis = axis;
+    buildTLASNode(start, mid);                 // 第一个子节点紧跟父节点
+    node.offset = buildTLASNode(mid, end);
+    tlasNodes[index] = node;
+    return index;
+}
+
+// 实例有改动时重建顶层BVH（每帧渲染前调用一次，只处理实例包围盒，与网格的三角形数无关）
+void updateInstances() {
+    instanceStats = InstanceStats();
+    if (!tlasDirty) return;
+    auto start = chrono::steady_clock::now();
+    tlasDirty = false;
+    sceneRevision++;
+    
+    tlasOrder.clear();
+    for (int id = 0; id < (int)instances.size(); id++) {
+        if (instances[id].visible) tlasOrder.push_back(id);
+    }
+    tlasNodes.clear();
+    if (!tlasOrder.empty()) {
+        tlasNodes.reserve(tlasOrder.size() * 2);
+        buildTLASNode(0, tlasOrder.size());
+    }
+    
+    instanceStats.instances = tlasOrder.size();
+    instanceStats.tlasNodes = tlasNodes.size();
+    instanceStats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// 释放所有网格和实例
+void releaseInstances() {
+    vector<Mesh>().swap(meshes);
+    vector<Instance>().swap(instances);
+    vector<LinearBVHNode>().swap(tlasNodes);
+    vector<int>().swap(tlasOrder);
+    tlasDirty = false;
+}
+
+// 把世界空间的光线变换到实例的物体空间：方向不归一化，因此物体空间中的t与世界空间相同
+inline void toInstanceSpace(const Instance& inst, const Ray& ray, Ray& local) {
+    transformPoint(inst.inverse, ray.origin, local.origin);
+    transformVector(inst.inverse, ray.direction, local.direction);
+    local.coneWidth = ray.coneWidth;
+    local.coneSpread = ray.coneSpread;
+}
+
+// 光线与顶层节点包围盒求交（Slab方法）
+inline bool rayHitsTLASNode(const LinearBVHNode& node, const RayTraversal& rt, double tMax) {
+    double t0 = -1e30, t1 = 1e30;
+    for (int axis = 0; axis < 3; axis++) {
+        double a = (node.bmin[axis] - rt.origin[axis]) * rt.invDir[axis];
+        double b = (node.bmax[axis] - rt.origin[axis]) * rt.invDir[axis];
+        if (a > b) swap(a, b);
+        t0 = max(t0, a);
+        t1 = min(t1, b);
+    }
+    t1 *= 1.00001;
+    return t0 <= t1 && t1 > 1e-6 && t0 <= tMax;
+}
+
+// 顶层BVH最近命中遍历：叶子中的每个实例把光线变换到物体空间，再遍历网格的底层BVH
+template <int LEVEL>
+void intersectInstanceTree(const Ray& ray, HitRecord& hit) {
+    RayTraversal rt(ray);
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    
+    while (stackSize > 0) {
+        int index = stack[--stackSize];
+        const LinearBVHNode& node = tlasNodes[index];
+        if (!rayHitsTLASNode(node, rt, hit.t)) continue;
+        
+        if (node.count > 0) {
+            for (int i = node.offset; i < node.offset + node.count; i++) {
+                int id = tlasOrder[i];
+                const Instance& inst = instances[id];
+                Ray local;
+                toInstanceSpace(inst, ray, local);
+                double before = hit.t;
+                intersectWideBVH<LEVEL>(meshes[inst.mesh].bvh, local, hit);
+                if (hit.t < before) hit.instance = id;
+            }
+            continue;
+        }
+        
+        // 沿光线方向先访问划分轴上较近的子节点
+        int nearChild = index + 1, farChild = node.offset;
+        if (rt.invDir[node.axis] < 0) swap(nearChild, farChild);
+        stack[stackSize++] = farChild;
+        stack[stackSize++] = nearChild;
+    }
+}
+
+// 顶层BVH遮挡遍历（任意命中）
+// 实例覆盖了材质时按覆盖后的材质判断：覆盖为材质3的实例只算部分遮挡
+template <int LEVEL>
+bool occludedInstanceTree(const Ray& ray, double tMax, bool* partial) {
+    RayTraversal rt(ray);
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    
+    while (stackSize > 0) {
+        int index = stack[--stackSize];
+        const LinearBVHNode& node = tlasNodes[index];
+        if (!rayHitsTLASNode(node, rt, tMax)) continue;
+        
+        if (node.count > 0) {
+            for (int i = node.offset; i < node.offset + node.count; i++) {
+                const Instance& inst = instances[tlasOrder[i]];
+                Ray local;
+                toInstanceSpace(inst, ray, local);
+                bool* meshPartial = inst.materialType < 0 ? partial : nullptr;
+                if (!occludedWideBVH<LEVEL>(meshes[inst.mesh].bvh, local, tMax, meshPartial)) continue;
+                if (inst.materialType == 3 && partial != nullptr) {
+                    *partial = true;
+                    continue;
+                }
+                return true;
+            }
+            continue;
+        }
+        
+        stack[stackSize++] = index + 1;
+        stack[stackSize++] = node.offset;
+    }
+    return false;
+}
+
+// 实例求交（按运行时指令集级别分派）：更近的命中会覆盖hit并记录实例编号
+void intersectInstances(const Ray& ray, HitRecord& hit) {
+    if (tlasNodes.empty()) return;
+    switch (simdLevel) {
+        case SIMD_AVX2: intersectInstanceTree<SIMD_AVX2>(ray, hit); break;
+        case SIMD_SSE: intersectInstanceTree<SIMD_SSE>(ray, hit); break;
+        default: intersectInstanceTree<SIMD_SCALAR>(ray, hit); break;
+    }
+}
+
+// 实例遮挡查询
+bool occludedInstances(const Ray& ray, double tMax, bool* partial) {
+    if (tlasNodes.empty()) return false;
+    switch (simdLevel) {
+        case SIMD_AVX2: return occludedInstanceTree<SIMD_AVX2>(ray, tMax, partial);
+        case SIMD_SSE: return occludedInstanceTree<SIMD_SSE>(ray, tMax, partial);
+        default: return occludedInstanceTree<SIMD_SCALAR>(ray, tMax, partial);
+    }
+}
+
+// 遍历结束后计算最终命中的属性：网格实例的边先变换到世界空间再求法线和面积，最后应用实例的材质覆盖
+void resolveHit(const Ray& ray, HitRecord& hit) {
+    const Instance* inst = hit.instance >= 0 ? &instances[hit.instance] : nullptr;
+    const WideBVH& bvh = inst != nullptr ? meshes[inst->mesh].bvh : sceneBVH;
+    const TriangleGeometry& g = bvh.geometry;
+    int slot = hit.prim;
+    double edge1[3] = {g.e1[0][slot], g.e1[1][slot], g.e1[2][slot]};
+    double edge2[3] = {g.e2[0][slot], g.e2[1][slot], g.e2[2][slot]};
+    if (inst == nullptr) {
+        resolveTriangleHit(ray, hit, bvh.indices[slot], edge1, edge2);
+        return;
+    }
+    
+    double worldEdge1[3], worldEdge2[3];
+    transformVector(inst->transform, edge1, worldEdge1);
+    transformVector(inst->transform, edge2, worldEdge2);
+    resolveTriangleHit(ray, hit, bvh.indices[slot], worldEdge1, worldEdge2);
+    if (inst->materialType >= 0) hit.materialType = inst->materialType;
+    if (inst->color >= 0) {
+        hit.color = inst->color;
+        hit.textureId = -1;
+    }
+}
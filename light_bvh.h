@@ -0,0 +1,166 @@
+// light_bvh.cpp - 光源BVH：光源很多时按估计贡献在树上随机下行，每个着色点只采样少量光源（贡献除以选中概率，无偏）
+
+#include "vector.h"
+#include <bits/stdc++.h>
+using namespace std;
+
+// 光源BVH节点（深度优先顺序，第一个子节点紧跟父节点）
+struct LightBVHNode {
+    double bmin[3], bmax[3];        // 子树内光源位置的包围盒
+    double center[3];               // 包围盒的外接球（叶子半径为0）
+    double radius;
+    double power;                   // 子树内光源功率之和（强度×颜色三通道平均）
+    int offset;                     // 叶子：光源编号；内部节点：第二个子节点的下标
+    int count;                      // 叶子为1，内部节点为0
+};
+
+// 最近一次updateLightBVH的统计
+struct LightBVHStats {
+    int lights = 0;                 // 进入光源BVH的光源数（功率为0的光源不会被采样到，不进树）
+    int nodes = 0;
+    double ms = 0;
+};
+
+int lightSampleCount = 4;           // 每个着色点采样的光源数；光源不超过这个数时逐个计算，结果与不用光源BVH相同
+vector<LightBVHNode> lightNodes;
+vector<int> lightOrder;             // 构建用的光源编号
+LightBVHStats lightBVHStats;
+
+// 光源功率：强度乘以颜色三通道平均
+inline double lightPower(const PointLight& light) {
+    return light.intensity * (light.color[0] + light.color[1] + light.color[2]) / 3.0;
+}
+
+// 构建lightOrder[start, end)的子树：按光源位置在最长轴上取中位数划分，返回节点下标
+int buildLightNode(int start, int end) {
+    int index = lightNodes.size();
+    lightNodes.push_back(LightBVHNode());
+    
+    LightBVHNode node;
+    AABB box;
+    node.power = 0;
+    for (int i = start; i < end; i++) {
+        const PointLight& light = pointLights[lightOrder[i]];
+        growAABB(box, {light.position[0], light.position[1], light.position[2]});
+        node.power += lightPower(light);
+    }
+    double radius2 = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        node.bmin[axis] = box.min[axis];
+        node.bmax[axis] = box.max[axis];
+        double half = (box.max[axis] - box.min[axis]) * 0.5;
+        node.center[axis] = box.min[axis] + half;
+        radius2 += half * half;
+    }
+    node.radius = sqrt(radius2);
+    
+    if (end - start == 1) {
+        node.offset = lightOrder[start];
+        node.count = 1;
+        lightNodes[index] = node;
+        return index;
+    }
+    
+    int axis = 0;
+    for (int k = 1; k < 3; k++) {
+        if (box.max[k] - box.min[k] > box.max[axis] - box.min[axis]) axis = k;
+    }
+    int mid = (start + end) / 2;
+    nth_element(lightOrder.begin() + start, lightOrder.begin() + mid, lightOrder.begin() + end,
+                [axis](int a, int b) { return pointLights[a].position[axis] < pointLights[b].position[axis]; });
+    node.count = 0;
+    buildLightNode(start, mid);                 // 第一个子节点紧跟父节点
+    node.offset = buildLightNode(mid, end);
+    lightNodes[index] = node;
+    return index;
+}
+
+// 光源有改动时重建光源BVH（每帧渲染前调用一次，与光源数成N log N）
+void updateLightBVH() {
+    lightBVHStats = LightBVHStats();
+    if (!lightsDirty) return;
+    auto start = chrono::steady_clock::now();
+    lightsDirty = false;
+    sceneRevision++;
+    
+    lightOrder.clear();
+    for (int id = 0; id < (int)pointLights.size(); id++) {
+        if (lightPower(pointLights[id]) > 0) lightOrder.push_back(id);
+    }
+    lightNodes.clear();
+    if (!lightOrder.empty()) {
+        lightNodes.reserve(lightOrder.size() * 2);
+        buildLightNode(0, lightOrder.size());
+    }
+    
+    lightBVHStats.lights = lightOrder.size();
+    lightBVHStats.nodes = lightNodes.size();
+    lightBVHStats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void releaseLightBVH() {
+    vector<LightBVHNode>().swap(lightNodes);
+    vector<int>().swap(lightOrder);
+}
+
+// 子树对着色点(p, n)贡献的估计：功率 × 法线余弦上界 ÷ 包围盒最近处的衰减
+// 对子树内任一光源都不小于它不计阴影时的真实贡献；叶子上恰好等于该光源不计阴影的贡献
+inline double lightNodeImportance(const LightBVHNode& node, double p[3], double n[3]) {
+    double v[3] = {node.center[0] - p[0], node.center[1] - p[1], node.center[2] - p[2]};
+    double dist = sqrt(dot(v, v));
+    
+    // 着色点到包围盒的最近距离
+    double d2 = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        double outside = max(0.0, max(node.bmin[axis] - p[axis], p[axis] - node.bmax[axis]));
+        d2 += outside * outside;
+    }
+    double d = node.radius > 0 ? sqrt(d2) : dist;
+    double falloff = 1.0 / (1.0 + 0.01 * d * d + 0.1 * d);     // 衰减与calculateAttenuation相同
+    if (dist <= node.radius) return node.power * falloff;     // 着色点在包围球内
+    
+    // 法线与包围球内方向夹角余弦的上界：中心方向的夹角减去包围球的半张角
+    double cosTheta = dot(v, n) / dist;
+    double cosBound = max(0.0, cosTheta);
+    if (node.radius > 0) {
+        double sinAlpha = node.radius / dist;
+        double cosAlpha = sqrt(1.0 - sinAlpha * sinAlpha);
+        if (cosTheta >= cosAlpha) {
+            cosBound = 1.0;
+        } else {
+            double sinTheta = sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
+            cosBound = max(0.0, cosTheta * cosAlpha + sinTheta * sinAlpha);
+        }
+    }
+    return node.power * cosBound * falloff;
+}
+
+// 按重要性从根向下随机选一个光源，u为[0, 1)内的随机数；pdf返回选中该光源的概率
+// 所有光源都不可能照亮着色点时返回-1
+int sampleLightBVH(double p[3], double n[3], double u, double& pdf) {
+    pdf = 1.0;
+    if (lightNodes.empty()) return -1;
+    if (lightNodeImportance(lightNodes[0], p, n) <= 0) return -1;
+    
+    int index = 0;
+    while (lightNodes[index].count == 0) {
+        int left = index + 1, right = lightNodes[index].offset;
+        double wl = lightNodeImportance(lightNodes[left], p, n);
+        double wr = lightNodeImportance(lightNodes[right], p, n);
+        if (wl + wr <= 0) return -1;
+        
+        // 选中一侧后把u重新缩放到[0, 1)，继续用于下一层
+        double pl = wl / (wl + wr);
+        if (u < pl) {
+            u = u / pl;
+            pdf *= pl;
+            index = left;
+        } else {
+            u = (u - pl) / (1.0 - pl);
+            pdf *= 1.0 - pl;
+            index = right;
+        }
+        u = min(u, 1.0 - 1e-12);
+    }
+    return lightNodes[index].offset;
+}
@@ -0,0 +1,345 @@
+// obj_loader.cpp - OBJ快速解析：内存映射文件，按行边界分块多线程解析，手写数字解析，多边形扇形三角化
+
+#include "vector.h"
+#include <bits/stdc++.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <omp.h>
+using namespace std;
+
+const size_t OBJ_MIN_CHUNK_SIZE = 1 << 20;  // 每块至少1MB，小文件不值得分块
+
+// 内存映射的文件（只读，或写时复制：写入只修改本进程的内存页，不会写回文件）
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = NULL;
+#else
+    int fd = -1;
+#endif
+    
+    bool open(const char* filename, bool copyOnWrite = false) {
+#ifdef _WIN32
+        file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) return false;
+        size = (size_t)fileSize.QuadPart;
+        if (size == 0) return true;
+        mapping = CreateFileMappingA(file, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL) return false;
+        data = (const char*)MapViewOfFile(mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+        return data != nullptr;
+#else
+        fd = ::open(filename, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) return false;
+        size = (size_t)st.st_size;
+        if (size == 0) return true;
+        void* p = mmap(NULL, size, copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) return false;
+        if (!copyOnWrite) madvise(p, size, MADV_SEQUENTIAL);     // 写时复制的映射按需随机访问
+        data = (const char*)p;
+        return true;
+#endif
+    }
+    
+    void close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping != NULL) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap((void*)data, size);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+    
+    void swap(MappedFile& other) {
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+#ifdef _WIN32
+        std::swap(file, other.file);
+        std::swap(mapping, other.mapping);
+#else
+        std::swap(fd, other.fd);
+#endif
+    }
+    
+    ~MappedFile() { close(); }
+};
+
+// 面顶点的索引（已转成从0开始）；relative的对应位表示该索引是负数（相对引用），还需加上前面各块的元素数
+struct ObjCorner {
+    int v, vt, vn;          // -1表示未给出
+    unsigned char relative; // 1: v, 2: vt, 4: vn
+};
+
+// 一块文本的解析结果
+struct ObjChunk {
+    vector<double> positions;   // x, y, z
+    vector<double> texCoords;   // u, v（v已翻转）
+    int normalCount = 0;        // 法线只计数（渲染使用几何法线），用于解析相对索引和检查越界
+    vector<ObjCorner> corners;  // 三角化后每3个一个三角形
+    int skippedFaces = 0;       // 顶点不足3个或格式错误的面
+};
+
+// OBJ解析结果
+struct ObjMesh {
+    vector<double> positions, texCoords;
+    int normalCount = 0;        // vn行数（法线数据不保存）
+    vector<ObjCorner> corners;  // 每3个一个三角形，索引已全部转为绝对下标
+    int skippedFaces = 0;
+};
+
+const double objPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool isObjSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skipObjSpace(const char* p, const char* end) {
+    while (p < end && isObjSpace(*p)) p++;
+    return p;
+}
+
+// 解析浮点数（不依赖locale）：有效数字不超过19位且10的指数不超过22时，
+// 整数尾数乘除一次10的幂即为正确舍入的结果，与strtod相同；其余情况交给strtod
+const char* parseObjDouble(const char* p, const char* end, double& value) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false, truncated = false;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa != 0) digits++;
+        } else {
+            exponent++;
+            truncated |= *p != '0';
+        }
+        p++;
+        any = true;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0) digits++;
+                exponent--;
+            } else {
+                truncated |= *p != '0';
+            }
+            p++;
+            any = true;
+        }
+    }
+    if (!any) {
+        value = 0;
+        return start;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool expNegative = false;
+        if (q < end && (*q == '-' || *q == '+')) expNegative = *q++ == '-';
+        if (q < end && *q >= '0' && *q <= '9') {
+            int e = 0;
+            while (q < end && *q >= '0' && *q <= '9') {
+                if (e < 10000) e = e * 10 + (*q - '0');
+                q++;
+            }
+            exponent += expNegative ? -e : e;
+            p = q;
+        }
+    }
+    
+    if (!truncated && mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        double m = (double)mantissa;
+        value = exponent < 0 ? m / objPow10[-exponent] : m * objPow10[exponent];
+    } else {
+        // 有效数字过多或指数过大（极少见）：复制到以0结尾的缓冲区再用strtod
+        string text(start, p);
+        value = strtod(text.c_str(), NULL);
+        return p;
+    }
+    if (negative) value = -value;
+    return p;
+}
+
+// 解析整数（面索引），没有数字时返回原指针
+inline const char* parseObjInt(const char* p, const char* end, int& value) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    const char* digitsStart = p;
+    long long v = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (v < INT_MAX) v = v * 10 + (*p - '0');
+        p++;
+    }
+    if (p == digitsStart) return start;
+    value = (int)min<long long>(v, INT_MAX) * (negative ? -1 : 1);
+    return p;
+}
+
+// 把OBJ索引转成从0开始的下标：正数从1开始，负数相对当前已定义的个数（-1为最后一个）
+inline int resolveObjIndex(int index, int localCount, unsigned char bit, unsigned char& relative) {
+    if (index > 0) return index - 1;
+    relative |= bit;
+    return localCount + index;  // 可能为负，表示引用前面块中的元素
+}
+
+// 解析一行中的一个面顶点 v、v/vt、v//vn 或 v/vt/vn
+const char* parseObjCorner(const char* p, const char* end, const ObjChunk& chunk, ObjCorner& corner, bool& ok) {
+    corner.v = corner.vt = corner.vn = -1;
+    corner.relative = 0;
+    int index = 0;
+    const char* q = parseObjInt(p, end, index);
+    if (q == p || index == 0) {
+        ok = false;
+        return q;
+    }
+    corner.v = resolveObjIndex(index, chunk.positions.size() / 3, 1, corner.relative);
+    p = q;
+    if (p < end && *p == '/') {
+        p++;
+        q = parseObjInt(p, end, index);
+        if (q != p && index != 0) corner.vt = resolveObjIndex(index, chunk.texCoords.size() / 2, 2, corner.relative);
+        p = q;
+        if (p < end && *p == '/') {
+            p++;
+            q = parseObjInt(p, end, index);
+            if (q != p && index != 0) corner.vn = resolveObjIndex(index, chunk.normalCount, 4, corner.relative);
+            p = q;
+        }
+    }
+    return p;
+}
+
+// 解析[begin, end)内的所有行，n边形按扇形(0, i, i+1)拆成n-2个三角形
+void parseObjChunk(const char* begin, const char* end, ObjChunk& chunk) {
+    vector<ObjCorner> face;
+    const char* p = begin;
+    while (p < end) {
+        p = skipObjSpace(p, end);
+        const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+        if (lineEnd == NULL) lineEnd = end;
+        
+        if (p + 1 < lineEnd && p[0] == 'v' && isObjSpace(p[1])) {  // 顶点
+            double v[3] = {0, 0, 0};
+            const char* q = p + 2;
+            for (int k = 0; k < 3; k++) q = parseObjDouble(skipObjSpace(q, lineEnd), lineEnd, v[k]);
+            chunk.positions.insert(chunk.positions.end(), v, v + 3);
+        } else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 't' && isObjSpace(p[2])) {  // 纹理坐标
+            double u = 0, v = 0;
+            const char* q = parseObjDouble(skipObjSpace(p + 3, lineEnd), lineEnd, u);
+            parseObjDouble(skipObjSpace(q, lineEnd), lineEnd, v);
+            chunk.texCoords.push_back(u);
+            chunk.texCoords.push_back(1.0 - v);   // 翻转Y轴
+        } else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 'n' && isObjSpace(p[2])) {  // 法线：只计数
+            chunk.normalCount++;
+        } else if (p + 1 < lineEnd && p[0] == 'f' && isObjSpace(p[1])) {  // 面
+            face.clear();
+            bool ok = true;
+            const char* q = skipObjSpace(p + 2, lineEnd);
+            while (ok && q < lineEnd && *q != '#') {
+                ObjCorner corner;
+                q = parseObjCorner(q, lineEnd, chunk, corner, ok);
+                if (ok) face.push_back(corner);
+                q = skipObjSpace(q, lineEnd);
+            }
+            if (!ok || face.size() < 3) {
+                chunk.skippedFaces++;
+            } else {
+                for (size_t i = 1; i + 1 < face.size(); i++) {
+                    chunk.corners.push_back(face[0]);
+                    chunk.corners.push_back(face[i]);
+                    chunk.corners.push_back(face[i + 1]);
+                }
+            }
+        }
+        // 其他行（注释、o、g、s、usemtl、mtllib等）忽略
+        
+        p = lineEnd < end ? lineEnd + 1 : end;   // 最后一行可能没有换行符
+    }
+}
+
+// 解析OBJ文件：文件按行边界分成若干块并行解析，再按块顺序合并并把相对索引转为绝对下标
+bool parseOBJFile(const char* filename, ObjMesh& mesh) {
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    const char* data = file.data;
+    size_t size = file.size;
+    
+    int chunkCount = (int)max<size_t>(1, min<size_t>(size / OBJ_MIN_CHUNK_SIZE, omp_get_max_threads() * 4));
+    vector<size_t> bounds(chunkCount + 1, size);
+    bounds[0] = 0;
+    for (int i = 1; i < chunkCount; i++) {
+        size_t pos = max(bounds[i - 1], size / chunkCount * i);
+        const char* newline = pos < size ? (const char*)memchr(data + pos, '\n', size - pos) : NULL;
+        bounds[i] = newline ? newline - data + 1 : size;
+    }
+    
+    vector<ObjChunk> chunks(chunkCount);
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < chunkCount; i++) {
+        parseObjChunk(data + bounds[i], data + bounds[i + 1], chunks[i]);
+    }
+    
+    // 各块的元素在合并结果中的起始位置
+    vector<size_t> positionStart(chunkCount + 1, 0), texStart(chunkCount + 1, 0);
+    vector<size_t> normalStart(chunkCount + 1, 0), cornerStart(chunkCount + 1, 0);
+    for (int i = 0; i < chunkCount; i++) {
+        positionStart[i + 1] = positionStart[i] + chunks[i].positions.size();
+        texStart[i + 1] = texStart[i] + chunks[i].texCoords.size();
+        normalStart[i + 1] = normalStart[i] + chunks[i].normalCount;
+        cornerStart[i + 1] = cornerStart[i] + chunks[i].corners.size();
+        mesh.skippedFaces += chunks[i].skippedFaces;
+    }
+    mesh.positions.resize(positionStart[chunkCount]);
+    mesh.texCoords.resize(texStart[chunkCount]);
+    mesh.normalCount = normalStart[chunkCount];
+    mesh.corners.resize(cornerStart[chunkCount]);
+    
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < chunkCount; i++) {
+        ObjChunk& chunk = chunks[i];
+        copy(chunk.positions.begin(), chunk.positions.end(), mesh.positions.begin() + positionStart[i]);
+        copy(chunk.texCoords.begin(), chunk.texCoords.end(), mesh.texCoords.begin() + texStart[i]);
+        
+        int positionBase = positionStart[i] / 3, texBase = texStart[i] / 2, normalBase = normalStart[i];
+        for (size_t k = 0; k < chunk.corners.size(); k++) {
+            ObjCorner c = chunk.corners[k];
+            if (c.relative & 1) c.v += positionBase;
+            if (c.relative & 2) c.vt += texBase;
+            if (c.relative & 4) c.vn += normalBase;
+            c.relative = 0;
+            mesh.corners[cornerStart[i] + k] = c;
+        }
+        vector<double>().swap(chunk.positions);
+        vector<double>().swap(chunk.texCoords);
+        vector<ObjCorner>().swap(chunk.corners);
+    }
+    return true;
+}
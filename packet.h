@@ -0,0 +1,208 @@
+// packet.cpp - 光线包遍历：相邻主光线成组遍历四叉BVH，共享节点测试并用区间包围整组光线剔除子树
+
+#include "vector.h"
+#include <bits/stdc++.h>
+using namespace std;
+
+const int PACKET_SIZE = 8;                          // 光线包边长（8x8条光线）
+const int MAX_PACKET_RAYS = PACKET_SIZE * PACKET_SIZE;
+const int PACKET_SPLIT_RAYS = 4;                    // 活跃光线范围不超过此数时退回逐条遍历
+
+// 光线包：每条光线的遍历参数，以及整组光线原点和方向倒数的区间
+struct RayPacket {
+    int count = 0;
+    WideRay rays[MAX_PACKET_RAYS];
+    float originLo[3], originHi[3];
+    float invLo[3], invHi[3];
+    int dirNeg[3];
+    bool coherent = true;   // 各轴方向符号一致时才能用区间测试
+    
+    RayPacket() {}
+};
+
+// 单条光线与四叉节点第c个子节点的包围盒求交（与intersectChildrenScalar完全相同的计算）
+inline bool rayHitsChild(const WideBVHNode& node, int c, const WideRay& wr, float tLimit) {
+    float t0 = -1e30f, t1 = 1e30f;
+    for (int axis = 0; axis < 3; axis++) {
+        float nearPlane = wr.dirNeg[axis] ? node.bmax[axis][c] : node.bmin[axis][c];
+        float farPlane = wr.dirNeg[axis] ? node.bmin[axis][c] : node.bmax[axis][c];
+        t0 = max(t0, (nearPlane - wr.origin[axis]) * wr.invDir[axis]);
+        t1 = min(t1, (farPlane - wr.origin[axis]) * wr.invDir[axis]);
+    }
+    t1 *= 1.00001f;
+    return t0 <= t1 && t1 > 1e-6f && t0 <= tLimit;
+}
+
+// 区间乘法的下界和上界
+inline float intervalMulLo(float aLo, float aHi, float bLo, float bHi) {
+    return min(min(aLo * bLo, aLo * bHi), min(aHi * bLo, aHi * bHi));
+}
+inline float intervalMulHi(float aLo, float aHi, float bLo, float bHi) {
+    return max(max(aLo * bLo, aLo * bHi), max(aHi * bLo, aHi * bHi));
+}
+
+// 整组光线与四个子节点包围盒的区间测试：返回可能被某条光线命中的子节点掩码
+// 浮点乘减单调，区间端点的计算结果不会比任何一条光线更紧，因此剔除是保守的
+inline int packetChildrenMask(const WideBVHNode& node, const RayPacket& packet,
+                              float tLimit, float tNear[4]) {
+    int mask = 0;
+    for (int c = 0; c < 4; c++) {
+        if (node.child[c] < 0) continue;
+        float t0 = -1e30f, t1 = 1e30f;
+        for (int axis = 0; axis < 3; axis++) {
+            float nearPlane = packet.dirNeg[axis] ? node.bmax[axis][c] : node.bmin[axis][c];
+            float farPlane = packet.dirNeg[axis] ? node.bmin[axis][c] : node.bmax[axis][c];
+            float nearLo = nearPlane - packet.originHi[axis], nearHi = nearPlane - packet.originLo[axis];
+            float farLo = farPlane - packet.originHi[axis], farHi = farPlane - packet.originLo[axis];
+            t0 = max(t0, intervalMulLo(nearLo, nearHi, packet.invLo[axis], packet.invHi[axis]));
+            t1 = min(t1, intervalMulHi(farLo, farHi, packet.invLo[axis], packet.invHi[axis]));
+        }
+        t1 *= 1.00001f;
+        tNear[c] = t0;
+        if (t0 <= t1 && t1 > 1e-6f && t0 <= tLimit) mask |= 1 << c;
+    }
+    return mask;
+}
+
+// 初始化光线包：计算每条光线的遍历参数和整组区间，方向符号不一致时标记为不相干
+void setupPacket(const Ray* rays, int count, RayPacket& packet) {
+    packet.count = count;
+    packet.coherent = true;
+    for (int axis = 0; axis < 3; axis++) {
+        packet.originLo[axis] = packet.invLo[axis] = INFINITY;
+        packet.originHi[axis] = packet.invHi[axis] = -INFINITY;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        packet.rays[i] = WideRay(RayTraversal(rays[i]));
+        const WideRay& wr = packet.rays[i];
+        for (int axis = 0; axis < 3; axis++) {
+            if (i == 0) packet.dirNeg[axis] = wr.dirNeg[axis];
+            else if (packet.dirNeg[axis] != wr.dirNeg[axis]) packet.coherent = false;
+            packet.originLo[axis] = min(packet.originLo[axis], wr.origin[axis]);
+            packet.originHi[axis] = max(packet.originHi[axis], wr.origin[axis]);
+            packet.invLo[axis] = min(packet.invLo[axis], wr.invDir[axis]);
+            packet.invHi[axis] = max(packet.invHi[axis], wr.invDir[axis]);
+        }
+    }
+}
+
+// 光线包遍历栈元素：parent/slot指向子节点包围盒（parent为-1表示根节点），[first, last]为仍可能命中的光线范围
+struct PacketStackEntry {
+    int parent;
+    int slot;
+    int first, last;
+    float t;
+};
+
+// 光线包最近命中遍历
+// 每个子节点先做整组区间测试，通过后再从两端收缩出真正命中的光线范围，范围外的光线不再参与该子树
+template <int LEVEL>
+void intersectPacketBVH(const Ray* rays, HitRecord* hits, const RayPacket& packet) {
+    const WideBVHNode* nodes = sceneBVH.nodes.data();
+    int count = packet.count;
+    
+    // 整组最远的当前交点，只会变小，叶子处理后重新计算
+    float packetMaxT = 1e30f;
+    auto updateMaxT = [&]() {
+        double maxT = 0;
+        for (int i = 0; i < count; i++) maxT = max(maxT, hits[i].t);
+        packetMaxT = (float)min(maxT * 1.00001, 1e30);
+    };
+    updateMaxT();
+    
+    PacketStackEntry stack[3 * BVH_STACK_SIZE + 4];
+    int stackSize = 0;
+    stack[stackSize++] = {-1, 0, 0, count - 1, -1e30f};
+    
+    while (stackSize > 0) {
+        PacketStackEntry entry = stack[--stackSize];
+        if (entry.t > packetMaxT) continue;
+        
+        int first = entry.first, last = entry.last;
+        int nodeIndex = 0;
+        if (entry.parent >= 0) {
+            // 从两端收缩到第一条和最后一条命中该子节点包围盒的光线
+            const WideBVHNode& parent = nodes[entry.parent];
+            auto hitsChild = [&](int i) {
+                return rayHitsChild(parent, entry.slot, packet.rays[i], (float)min(hits[i].t * 1.00001, 1e30));
+            };
+            while (first <= last && !hitsChild(first)) first++;
+            if (first > last) continue;
+            while (last > first && !hitsChild(last)) last--;
+            
+            if (parent.count[entry.slot] > 0) {
+                // 叶子：每条光线单独测试包围盒，命中后再测试三角形
+                int start = parent.child[entry.slot], leafCount = parent.count[entry.slot];
+                for (int i = first; i <= last; i++) {
+                    if (i > first && i < last &&
+                        !hitsChild(i)) {
+                        continue;
+                    }
+                    intersectLeaf<LEVEL>(sceneBVH, rays[i], start, leafCount, hits[i]);
+                }
+                updateMaxT();
+                continue;
+            }
+            nodeIndex = parent.child[entry.slot];
+            
+            // 光线已经发散：剩下的光线很少时改为逐条遍历该子树
+            if (last - first < PACKET_SPLIT_RAYS) {
+                for (int i = first; i <= last; i++) {
+                    if (i == first || i == last || hitsChild(i)) intersectWideBVH<LEVEL>(sceneBVH, rays[i], hits[i], nodeIndex);
+                }
+                updateMaxT();
+                continue;
+            }
+        }
+        
+        // 内部节点：整组区间测试四个子节点，按进入距离从远到近入栈
+        const WideBVHNode& node = nodes[nodeIndex];
+        float tNear[4];
+        int mask = packetChildrenMask(node, packet, packetMaxT, tNear);
+        if (mask == 0) continue;
+        
+        int order[4], hitCount = 0;
+        for (int c = 0; c < 4; c++) {
+            if (!(mask & (1 << c))) continue;
+            int k = hitCount++;
+            while (k > 0 && tNear[order[k - 1]] < tNear[c]) {
+                order[k] = order[k - 1];
+                k--;
+            }
+            order[k] = c;
+        }
+        for (int k = 0; k < hitCount; k++) {
+            stack[stackSize++] = {nodeIndex, order[k], first, last, tNear[order[k]]};
+        }
+    }
+}
+
+// 光线包求交：hits只填写t、prim、instance和重心坐标，命中属性仍需调用resolveHit
+// 方向符号不一致（区间测试失效）时退回逐条光线遍历；实例化网格总是逐条光线遍历顶层BVH
+void intersectPacket(const Ray* rays, HitRecord* hits, int count) {
+    for (int i = 0; i < count; i++) {
+        hits[i].t = 1e9;
+        hits[i].hit = false;
+        hits[i].instance = -1;
+    }
+    if (count <= 0) return;
+    
+    static thread_local RayPacket packet;
+    if (!wideNodes.empty()) {
+        setupPacket(rays, count, packet);
+        if (!packet.coherent) {
+            for (int i = 0; i < count; i++) intersectBVH(rays[i], hits[i]);
+        } else {
+            switch (simdLevel) {
+                case SIMD_AVX2: intersectPacketBVH<SIMD_AVX2>(rays, hits, packet); break;
+                case SIMD_SSE: intersectPacketBVH<SIMD_SSE>(rays, hits, packet); break;
+                default: intersectPacketBVH<SIMD_SCALAR>(rays, hits, packet); break;
+            }
+        }
+    }
+    
+    if (!instances.empty()) {
+        for (int i = 0; i < count; i++) intersectInstances(rays[i], hits[i]);
+    }
+}
@@ -0,0 +1,193 @@
+// progressive.cpp - 渐进式渲染：相机静止时逐帧累积采样，按误差估计优先细化屏幕块，直到全分辨率超采样收敛
+
+#include "vector.h"
+#include <bits/stdc++.h>
+using namespace std;
+
+// 每个像素的累积结果
+struct AccumPixel {
+    float r = 0, g = 0, b = 0;  // 颜色和（0-255）
+    float lum2 = 0;             // 亮度平方和（0-1），用于估计像素方差
+    int n = 0;                  // 采样数
+};
+
+// 渐进式渲染参数
+struct ProgressiveConfig {
+    double budget = 1.0 / 16;   // 每帧采样预算（相对像素数），与原先STEP=4的代价相同
+    int maxSamples = 16;        // 每像素最多采样数
+    double threshold = 1e-5;    // 块误差低于此值视为收敛
+};
+
+ProgressiveConfig progressiveConfig;
+vector<AccumPixel> accumBuffer;
+vector<int> tileLevel;          // 每块的细化级别：0为4x4一个采样，1为2x2，2为全分辨率，3及以上为超采样
+vector<double> tileError;       // 每块的误差估计
+int progressiveTilesX = 0, progressiveTilesY = 0;
+Camera accumCamera;             // 累积缓冲对应的相机
+int accumWidth = 0, accumHeight = 0;
+unsigned int accumRevision = 0; // 累积缓冲对应的场景版本
+
+// 上一帧渐进渲染的统计
+struct ProgressiveStats {
+    long long samples = 0;      // 本帧追踪的采样数
+    int tiles = 0;              // 本帧细化的块数
+    int converged = 0;          // 已收敛的块数
+    double maxError = 0;        // 未收敛块中的最大误差
+};
+ProgressiveStats progressiveStats;
+
+inline double colorLuminance(COLORREF c) {
+    return (0.299 * GetRValue(c) + 0.587 * GetGValue(c) + 0.114 * GetBValue(c)) / 255.0;
+}
+
+// 各细化级别下需要采样的像素间距：0级4，1级2，2级及以上1
+inline int levelStep(int level) {
+    return level <= 0 ? 4 : (level == 1 ? 2 : 1);
+}
+
+// 清空累积缓冲（相机移动或分辨率变化时）
+void resetProgressive() {
+    accumBuffer.assign(screenWidth * screenHeight, AccumPixel());
+    progressiveTilesX = (screenWidth + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+    progressiveTilesY = (screenHeight + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+    tileLevel.assign(progressiveTilesX * progressiveTilesY, -1);
+    tileError.assign(progressiveTilesX * progressiveTilesY, 0.0);
+    accumCamera = camera;
+    accumWidth = screenWidth;
+    accumHeight = screenHeight;
+    accumRevision = sceneRevision;
+}
+
+// 相机、分辨率或场景是否与累积缓冲不一致
+bool progressiveCameraChanged() {
+    return accumWidth != screenWidth || accumHeight != screenHeight || !sameCameraPose(accumCamera, camera) ||
+           accumRevision != sceneRevision;
+}
+
+// 给像素(x, y)追加一个采样：第一个采样在像素中心，之后在像素内随机偏移
+void addPixelSample(int x, int y) {
+    AccumPixel& p = accumBuffer[y * screenWidth + x];
+    beginPixelSample(x, y, p.n);
+    Ray ray = p.n == 0 ? generateRay(x, y) : generateRayOffset(x, y, nextRandom() - 0.5, nextRandom() - 0.5);
+    COLORREF c = traceRay(ray, 1);
+    double lum = colorLuminance(c);
+    p.r += GetRValue(c);
+    p.g += GetGValue(c);
+    p.b += GetBValue(c);
+    p.lum2 += lum * lum;
+    p.n++;
+}
+
+// 把一块的当前结果写入帧缓冲：未采样的像素使用所在粗块左上角的采样
+// 同时更新块误差：相邻像素亮度差的平方均值（边缘需要更多采样）按最少采样数缩小，加上像素自身采样方差的均值
+void resolveTile(int tile, int x0, int y0, int x1, int y1) {
+    int step = levelStep(tileLevel[tile]);
+    double lum[RENDER_TILE_SIZE][RENDER_TILE_SIZE];
+    double pixelVar = 0;
+    int sampled = 0, minSamples = INT_MAX;
+    
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            const AccumPixel* p = &accumBuffer[y * screenWidth + x];
+            bool own = p->n > 0;
+            if (!own) p = &accumBuffer[(y - y % step) * screenWidth + (x - x % step)];
+            
+            double inv = p->n > 0 ? 1.0 / p->n : 0.0;
+            COLORREF c = RGB(p->r * inv + 0.5, p->g * inv + 0.5, p->b * inv + 0.5);
+            flash_screen[y * screenWidth + x] = c;
+            lum[y - y0][x - x0] = colorLuminance(c);
+            if (!own) continue;
+            
+            pixelVar += max(0.0, p->lum2 * inv - lum[y - y0][x - x0] * lum[y - y0][x - x0]) * inv;
+            minSamples = min(minSamples, p->n);
+            sampled++;
+        }
+    }
+    
+    double contrast = 0;
+    int pairs = 0;
+    for (int y = 0; y < y1 - y0; y++) {
+        for (int x = 0; x < x1 - x0; x++) {
+            if (x + 1 < x1 - x0) {
+                contrast += (lum[y][x] - lum[y][x + 1]) * (lum[y][x] - lum[y][x + 1]);
+                pairs++;
+            }
+            if (y + 1 < y1 - y0) {
+                contrast += (lum[y][x] - lum[y + 1][x]) * (lum[y][x] - lum[y + 1][x]);
+                pairs++;
+            }
+        }
+    }
+    
+    if (sampled == 0) {
+        tileError[tile] = 0;
+        return;
+    }
+    tileError[tile] = (pairs > 0 ? contrast / pairs : 0.0) / minSamples + pixelVar / sampled;
+}
+
+// 对一块执行下一步细化：粗级别补齐更细网格上的像素，全分辨率后每个像素追加一个采样，返回采样数
+long long refineTile(int tile, int x0, int y0, int x1, int y1) {
+    long long samples = 0;
+    int level = tileLevel[tile] + 1;
+    int step = levelStep(level);
+    for (int y = y0 - y0 % step; y < y1; y += step) {
+        for (int x = x0 - x0 % step; x < x1; x += step) {
+            AccumPixel& p = accumBuffer[y * screenWidth + x];
+            if (level <= 2 && p.n > 0) continue;
+            if (p.n >= progressiveConfig.maxSamples) continue;
+            addPixelSample(x, y);
+            samples++;
+        }
+    }
+    tileLevel[tile] = level;
+    resolveTile(tile, x0, y0, x1, y1);
+    return samples;
+}
+
+// 渲染一帧渐进式画面：相机移动后先整屏4x4采样，之后每帧在预算内细化误差最大的块
+void renderProgressive() {
+    updateCameraFrame();
+    if (accumBuffer.empty() || progressiveCameraChanged()) resetProgressive();
+    
+    // 选出本帧要细化的块：粗级别优先，同级别按误差从大到小
+    int tileCount = tileLevel.size();
+    vector<char> selected(tileCount, 0);
+    vector<pair<double, int>> order;
+    progressiveStats = ProgressiveStats();
+    for (int t = 0; t < tileCount; t++) {
+        int level = tileLevel[t];
+        if (level < 0) {
+            selected[t] = 1;        // 第一帧：所有块都做4x4采样
+            continue;
+        }
+        bool full = level >= 2 + progressiveConfig.maxSamples - 1;
+        if (level >= 2 && (tileError[t] < progressiveConfig.threshold || full)) {
+            progressiveStats.converged++;
+            continue;
+        }
+        progressiveStats.maxError = max(progressiveStats.maxError, tileError[t]);
+        order.push_back(make_pair((level < 2 ? 1e9 : 0) + tileError[t], t));
+    }
+    sort(order.begin(), order.end(), greater<pair<double, int>>());
+    
+    int tilePixels = RENDER_TILE_SIZE * RENDER_TILE_SIZE;
+    long long budget = (long long)(screenWidth * screenHeight * progressiveConfig.budget);
+    long long planned = 0;
+    for (size_t i = 0; i < order.size() && planned < budget; i++) {
+        int level = tileLevel[order[i].second];
+        planned += level == 0 ? tilePixels * 3 / 16 : (level == 1 ? tilePixels * 3 / 4 : tilePixels);
+        selected[order[i].second] = 1;
+    }
+    
+    // 由分块调度器并行细化选中的块（采样数在块内用局部变量累计，每块只写一次线程计数）
+    vector<long long> threadSamples(omp_get_max_threads(), 0);
+    renderTiles(1, [&](int x0, int y0, int x1, int y1) {
+        int tile = (y0 / RENDER_TILE_SIZE) * progressiveTilesX + x0 / RENDER_TILE_SIZE;
+        if (!selected[tile]) return;
+        threadSamples[omp_get_thread_num()] += refineTile(tile, x0, y0, x1, y1);
+    });
+    
+    for (size_t t = 0; t < threadSamples.size(); t++) progressiveStats.samples += threadSamples[t];
+    for (int t = 0; t < tileCount; t++) progressiveStats.tiles += selected[t];
+}
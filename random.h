@@ -0,0 +1,77 @@
+// random.cpp - 计数器型随机数：由像素、帧号和采样序号决定，与线程数和调度顺序无关
+
+#include "vector.h"
+#include <bits/stdc++.h>
+using namespace std;
+
+// 当前像素的随机数流：key由像素坐标和帧号哈希得到，counter为本像素已取的随机数个数
+struct PixelSampler {
+    unsigned long long key = 0;
+    unsigned long long counter = 0;
+};
+
+thread_local PixelSampler pixelSampler;
+
+// 64位整数混合（splitmix64的输出函数），输入相差1输出也充分打乱
+inline unsigned long long mixBits(unsigned long long z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// 开始一个像素采样：之后本线程取到的随机数只取决于(x, y, frame)和取数顺序
+void beginPixelSample(int x, int y, unsigned int frame) {
+    unsigned long long seed = ((unsigned long long)(unsigned int)y << 32) | (unsigned int)x;
+    pixelSampler.key = mixBits(seed ^ mixBits(frame + 0x9e3779b97f4a7c15ULL));
+    pixelSampler.counter = 0;
+}
+
+// 取下一个32位随机数（第counter个随机数 = 对key和counter做哈希，不依赖前面的结果）
+inline unsigned int nextRandomBits() {
+    unsigned long long n = pixelSampler.counter++;
+    return (unsigned int)(mixBits(pixelSampler.key + n * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+// 取[0, 1)内均匀分布的随机数
+inline double nextRandom() {
+    return nextRandomBits() * (1.0 / 4294967296.0);
+}
+
+// Sobol序列前两维的第index个点，用scrambleX/scrambleY做异或扰动（每个像素不同，分层性质不变）
+// 前2^k个点在2^k个等面积的格子里各有一个，16个点恰好覆盖4x4分层网格
+inline void sobolSample2D(unsigned int index, unsigned int scrambleX, unsigned int scrambleY,
+                          double& u, double& v) {
+    unsigned int x = 0, y = 0;
+    for (unsigned int bit = 0; bit < 32; bit++) {
+        if (index & (1u << bit)) x |= 1u << (31 - bit);
+    }
+    for (unsigned int d = 1u << 31; index != 0; index >>= 1, d ^= d >> 1) {
+        if (index & 1) y ^= d;
+    }
+    u = (x ^ scrambleX) * (1.0 / 4294967296.0);
+    v = (y ^ scrambleY) * (1.0 / 4294967296.0);
+}
+
+// 光源面上的二维采样：第index个（共count个）采样点
+// SAMPLER_SOBOL使用扰动Sobol序列；SAMPLER_RANDOM在sqrt(count)分层网格内抖动（count不是平方数时不分层）
+struct LightSampleSet {
+    unsigned int scrambleX, scrambleY;
+    int count, strata;
+    
+    LightSampleSet(int n) : count(n) {
+        scrambleX = nextRandomBits();
+        scrambleY = nextRandomBits();
+        strata = (int)sqrt((double)n);
+        if (strata * strata != n) strata = 1;
+    }
+    
+    void sample(int index, double& u, double& v) const {
+        if (lightSampler == SAMPLER_SOBOL) {
+            sobolSample2D(index, scrambleX, scrambleY, u, v);
+            return;
+        }
+        int i = index / strata % strata, j = index % strata;
+        u = (i + nextRandom()) / strata;
+        v = (j + nextRandom()) / strata;
+    }
+};
@@ -0,0 +1,142 @@
+// reproject.cpp - 时域重投影：相机移动时把上一帧的命中点投影到新画面，复用与视角无关的着色，只重新追踪空洞和轮换刷新的采样
+
+#include "vector.h"
+#include <bits/stdc++.h>
+using namespace std;
+
+const int REFRESH_PERIOD = 8;       // 每个采样点至少每8帧重新追踪一次
+
+// 一个采样点（每STEPxSTEP块一个）的缓存
+struct ReprojectSample {
+    double position[3];     // 主光线命中点（世界坐标）；未命中时为光线方向
+    COLORREF color;
+    bool reusable = false;  // 着色与视角无关（不透明漫反射），可以在新视角下复用
+    bool sky = false;       // 未命中场景（背景色）
+    int age = 0;            // 距上次追踪的帧数
+};
+
+// 重投影缓存：上一帧各采样点的结果
+vector<ReprojectSample> reprojectCache;
+int reprojectStep = 0, reprojectWidth = 0, reprojectHeight = 0;
+double reprojectOrigin[3];      // 缓存对应的相机位置
+unsigned int reprojectFrame = 0;
+unsigned int reprojectRevision = 0;     // 缓存对应的场景版本
+
+// 上一帧重投影渲染的统计
+struct ReprojectStats {
+    int reused = 0;         // 复用的采样点数
+    int traced = 0;         // 重新追踪的采样点数
+    int refreshed = 0;      // 其中因轮换刷新而追踪的数量
+};
+ReprojectStats reprojectStats;
+
+// 命中点的着色是否与视角无关：不透明漫反射表面（镜面、半透明和纹理透明像素随视角变化）
+bool isViewIndependent(const HitRecord& hit) {
+    if (!hit.hit || hit.materialType != 1) return false;
+    if (hit.textureId >= 0) {
+        const TextureData* tex = getTexture(hit.textureId);
+        if (tex) {
+            BYTE alpha;
+            sampleTexture(*tex, hit.tex_u, hit.tex_v, alpha);
+            if (alpha < 250) return false;
+        }
+    }
+    return true;
+}
+
+// 清空重投影缓存（下一帧全部重新追踪）
+void resetReprojection() {
+    reprojectCache.clear();
+}
+
+// 渲染一帧：上一帧可复用的采样点按新相机投影到最近的采样位置（深度测试保留最近的），
+// 其余采样点和本帧轮换到的刷新采样点重新追踪；每个采样点填满STEPxSTEP块
+void renderReprojected(int STEP) {
+    updateCameraFrame();
+    int cols = (screenWidth + STEP - 1) / STEP;
+    int rows = (screenHeight + STEP - 1) / STEP;
+    if (reprojectStep != STEP || reprojectWidth != screenWidth || reprojectHeight != screenHeight ||
+        reprojectRevision != sceneRevision) {
+        reprojectCache.clear();
+        reprojectRevision = sceneRevision;
+        reprojectStep = STEP;
+        reprojectWidth = screenWidth;
+        reprojectHeight = screenHeight;
+    }
+    
+    // 相机只旋转时背景采样按方向投影；相机平移后背景可能被视差露出的物体遮挡，全部重新追踪
+    bool sameOrigin = reprojectOrigin[0] == camera.x && reprojectOrigin[1] == camera.y && reprojectOrigin[2] == camera.z;
+    reprojectOrigin[0] = camera.x;
+    reprojectOrigin[1] = camera.y;
+    reprojectOrigin[2] = camera.z;
+    
+    // 把上一帧的可复用采样投影到新画面
+    vector<ReprojectSample> current(cols * rows);
+    vector<double> depth(cols * rows, 1e30);
+    vector<char> valid(cols * rows, 0);
+    for (size_t i = 0; i < reprojectCache.size(); i++) {
+        const ReprojectSample& s = reprojectCache[i];
+        if (!s.reusable || (s.sky && !sameOrigin)) continue;
+        
+        double x, y, d;
+        if (s.sky) {
+            double far[3] = {camera.x + s.position[0], camera.y + s.position[1], camera.z + s.position[2]};
+            if (!projectToScreen(far, x, y, d)) continue;
+            d = 1e20;           // 背景在所有命中点之后
+        } else if (!projectToScreen(s.position, x, y, d)) {
+            continue;
+        }
+        int c = (int)floor(x / STEP + 0.5), r = (int)floor(y / STEP + 0.5);
+        if (c < 0 || c >= cols || r < 0 || r >= rows) continue;
+        
+        int cell = r * cols + c;
+        if (d < depth[cell]) {
+            depth[cell] = d;
+            current[cell] = s;
+            current[cell].age++;
+            valid[cell] = 1;
+        }
+    }
+    
+    // 重新追踪空洞和轮换刷新的采样点
+    reprojectFrame++;
+    vector<int> threadTraced(omp_get_max_threads(), 0), threadRefreshed(omp_get_max_threads(), 0);
+    renderTiles(STEP, [&](int x0, int y0, int x1, int y1) {
+        int thread = omp_get_thread_num();
+        for (int y = y0; y < y1; y += STEP) {
+            for (int x = x0; x < x1; x += STEP) {
+                int c = x / STEP, r = y / STEP, cell = r * cols + c;
+                ReprojectSample& s = current[cell];
+                bool refresh = valid[cell] &&
+                               (s.age >= REFRESH_PERIOD || (c * 3 + r * 5 + reprojectFrame) % REFRESH_PERIOD == 0);
+                
+                if (!valid[cell] || refresh) {
+                    Ray ray = generateRay(x, y);
+                    beginPixelSample(x, y, sampleFrame);
+                    HitRecord hit;
+                    intersectScene(ray, hit);
+                    s.color = shadeHit(ray, 1, hit);
+                    s.sky = !hit.hit;
+                    s.reusable = s.sky || isViewIndependent(hit);
+                    s.age = 0;
+                    const double* p = s.sky ? ray.direction : hit.position;
+                    s.position[0] = p[0];
+                    s.position[1] = p[1];
+                    s.position[2] = p[2];
+                    threadTraced[thread]++;
+                    if (refresh) threadRefreshed[thread]++;
+                }
+                
+                fillBlock(x, y, STEP, s.color);
+            }
+        }
+    });
+    
+    reprojectCache.swap(current);
+    reprojectStats = ReprojectStats();
+    for (size_t t = 0; t < threadTraced.size(); t++) {
+        reprojectStats.traced += threadTraced[t];
+        reprojectStats.refreshed += threadRefreshed[t];
+    }
+    reprojectStats.reused = cols * rows - reprojectStats.traced;
+}
@@ -0,0 +1,371 @@
+// scene_cache.cpp - 二进制场景缓存：三角形、光源、纹理表和构建好的BVH按内存布局整段存盘，
+// 以源文件的大小、修改时间和内容哈希为键，源文件或BVH参数变化时自动重建
+
+#include "vector.h"
+#include <bits/stdc++.h>
+using namespace std;
+
+const unsigned int SCENE_CACHE_VERSION = 4;     // 文件布局或setupScene中的固定场景内容变化时递增
+const size_t SCENE_CACHE_ALIGN = 64;            // 各段按缓存行对齐，映射后可直接按数组访问
+
+// 缓存文件中的段
+enum SceneCacheSectionId {
+    SECTION_TRIANGLES,      // Triangle[triangleCount]
+    SECTION_APPEAR,         // 每个三角形一个字节的可见标记
+    SECTION_LIGHTS,         // PointLight[pointLightCount]
+    SECTION_INDICES,        // triangleIndices[slotCount]
+    SECTION_GEOMETRY,       // 三角形热数据：v0, e1, e2各3个分量，每个分量slotCount + 4个float
+    SECTION_WIDE_NODES,     // WideBVHNode[wideNodeCount]
+    SECTION_TEXTURES,       // SceneCacheTexture[textureCount]
+    SECTION_TEXTURE_DATA,   // 纹理文件名和整个mip金字塔的纹素（TexelBlock）
+    SECTION_COUNT
+};
+
+struct SceneCacheSection {
+    unsigned long long offset, bytes;   // 相对文件开头
+};
+
+// 纹理表的一项（偏移相对文件开头）
+struct SceneCacheTexture {
+    int width, height, loaded, nameLength;
+    int layout, levelCount;             // 各级尺寸由原图尺寸和布局推出，只用于校验
+    unsigned long long nameOffset, texelOffset, blockCount;
+};
+
+// 源文件的大小和修改时间（两者都没变时认为内容没变，不必重新哈希）
+struct SceneCacheStamp {
+    unsigned long long size, mtime;
+};
+
+struct SceneCacheHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int structSizes[4];        // Triangle, PointLight, WideBVHNode, SceneCacheTexture（不同编译器布局不同时作废）
+    unsigned long long paramsHash;      // BVH构建参数、纹理布局、缓存格式版本
+    unsigned long long sourceHash;      // 模型和纹理文件内容（以paramsHash为种子）
+    SceneCacheStamp sources[2];         // 写缓存时模型和纹理文件的大小、修改时间
+    int triangleCount, pointLightCount, slotCount, wideNodeCount, textureCount;
+    SceneCacheSection sections[SECTION_COUNT];
+};
+
+bool sceneCacheEnabled = true;          // 启动时优先从缓存加载场景
+MappedFile sceneCacheFile;              // 当前场景直接引用的缓存映射，releaseScene时关闭
+
+// 64位内容哈希：4路并行的乘加-循环移位，逐8字节处理（xxHash64的主循环结构）
+inline unsigned long long rotateLeft64(unsigned long long x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+unsigned long long hashBytes(const char* data, size_t size, unsigned long long seed) {
+    const unsigned long long P1 = 0x9e3779b185ebca87ULL, P2 = 0xc2b2ae3d27d4eb4fULL;
+    unsigned long long lane[4] = {seed + P1 + P2, seed + P2, seed, seed - P1};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int k = 0; k < 4; k++) {
+            unsigned long long word;
+            memcpy(&word, data + i + k * 8, 8);
+            lane[k] = rotateLeft64(lane[k] + word * P2, 31) * P1;
+        }
+    }
+    unsigned long long h = rotateLeft64(lane[0], 1) + rotateLeft64(lane[1], 7) +
+                           rotateLeft64(lane[2], 12) + rotateLeft64(lane[3], 18) + size;
+    for (; i < size; i++) h = rotateLeft64(h ^ (unsigned char)data[i] * P1, 11) * P2;
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    return h;
+}
+
+// 把一个文件的内容并入哈希，文件不存在时返回false
+bool hashFile(const char* filename, unsigned long long& hash) {
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    hash = hashBytes(file.data, file.size, hash);
+    return true;
+}
+
+// 场景的缓存键：先比较源文件的大小和修改时间，不一致时才读取全部内容计算哈希
+struct SceneCacheKey {
+    const char* objFile;
+    const char* textureFile;
+    SceneCacheStamp sources[2];
+    unsigned long long paramsHash;
+    unsigned long long sourceHash;      // 0表示还没计算
+};
+
+bool statSourceFile(const char* filename, SceneCacheStamp& stamp) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &info)) return false;
+    stamp.size = ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    stamp.mtime = ((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    if (stat(filename, &st) != 0) return false;
+    stamp.size = st.st_size;
+    stamp.mtime = st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+// 只取源文件的大小和修改时间，不读内容；源文件不存在时返回false
+bool initSceneCacheKey(SceneCacheKey& key, const char* objFile, const char* textureFile) {
+    memset(&key, 0, sizeof(key));
+    key.objFile = objFile;
+    key.textureFile = textureFile;
+    if (!statSourceFile(objFile, key.sources[0]) || !statSourceFile(textureFile, key.sources[1])) return false;
+    double params[5] = {(double)bvhConfig.maxLeafSize, (double)bvhConfig.maxDepth,
+                        (double)bvhConfig.binCount, bvhConfig.traversalCost, (double)textureLayout};
+    key.paramsHash = hashBytes((const char*)params, sizeof(params), SCENE_CACHE_VERSION);
+    return true;
+}
+
+// 源文件内容哈希，第一次调用时才读取文件；读取失败时返回0
+unsigned long long sceneSourceHash(SceneCacheKey& key) {
+    if (key.sourceHash != 0) return key.sourceHash;
+    unsigned long long hash = key.paramsHash;
+    if (!hashFile(key.objFile, hash) || !hashFile(key.textureFile, hash)) return 0;
+    return key.sourceHash = hash;
+}
+
+// 缓存文件路径：模型文件旁的 .scene 文件
+string sceneCachePath(const char* objFile) {
+    return string(objFile) + ".scene";
+}
+
+void fillSceneCacheHeader(SceneCacheHeader& header) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "E3DSCENE", 8);
+    header.version = SCENE_CACHE_VERSION;
+    header.structSizes[0] = sizeof(Triangle);
+    header.structSizes[1] = sizeof(PointLight);
+    header.structSizes[2] = sizeof(WideBVHNode);
+    header.structSizes[3] = sizeof(SceneCacheTexture);
+}
+
+// 源文件内容没变、只是大小或修改时间变了（如被touch或重新拷贝）：把新的记录写回缓存文件头，下次启动不必再哈希
+void refreshSceneCacheStamps(const string& path, const SceneCacheKey& key) {
+    fstream file(path, ios::in | ios::out | ios::binary);
+    if (!file.is_open()) return;
+    file.seekp(offsetof(SceneCacheHeader, sources));
+    file.write((const char*)key.sources, sizeof(key.sources));
+}
+
+// 从缓存加载整个场景（包括BVH），缓存不存在、版本不符或源文件有变化时返回false且不修改场景
+bool loadSceneCache(const string& path, SceneCacheKey& key) {
+    auto start = chrono::steady_clock::now();
+    
+    // 先只读文件头：大小和修改时间都没变时不读源文件
+    SceneCacheHeader expected, header;
+    fillSceneCacheHeader(expected);
+    ifstream in(path, ios::binary);
+    if (!in.read((char*)&header, sizeof(header))) return false;
+    in.close();
+    if (memcmp(header.magic, expected.magic, 8) != 0 || header.version != expected.version ||
+        memcmp(header.structSizes, expected.structSizes, sizeof(header.structSizes)) != 0 ||
+        header.paramsHash != key.paramsHash) {
+        return false;
+    }
+    if (memcmp(header.sources, key.sources, sizeof(key.sources)) != 0) {
+        if (sceneSourceHash(key) == 0 || header.sourceHash != key.sourceHash) return false;
+        refreshSceneCacheStamps(path, key);
+    }
+    
+    // 映射后再核对一次，防止两次打开之间缓存被另一个进程替换
+    unsigned long long sourceHash = header.sourceHash;
+    MappedFile file;
+    if (!file.open(path.c_str(), true) || file.size < sizeof(SceneCacheHeader)) return false;
+    memcpy(&header, file.data, sizeof(header));
+    if (header.sourceHash != sourceHash) return false;
+    
+    // 校验各段大小，防止截断或损坏的文件越界
+    size_t slots = header.slotCount + 4;
+    size_t expectedBytes[SECTION_COUNT] = {
+        header.triangleCount * sizeof(Triangle), (size_t)header.triangleCount,
+        header.pointLightCount * sizeof(PointLight), header.slotCount * sizeof(int),
+        9 * slots * sizeof(float), header.wideNodeCount * sizeof(WideBVHNode),
+        header.textureCount * sizeof(SceneCacheTexture), header.sections[SECTION_TEXTURE_DATA].bytes
+    };
+    if (header.triangleCount < 0 || header.pointLightCount < 0 || header.slotCount != header.triangleCount ||
+        header.wideNodeCount < 0 || header.textureCount < 0) {
+        return false;
+    }
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        const SceneCacheSection& section = header.sections[s];
+        if (section.bytes != expectedBytes[s] || section.offset > file.size ||
+            section.bytes > file.size - section.offset) {
+            return false;
+        }
+    }
+    const SceneCacheTexture* textures = (const SceneCacheTexture*)(file.data + header.sections[SECTION_TEXTURES].offset);
+    for (int t = 0; t < header.textureCount; t++) {
+        const SceneCacheTexture& tex = textures[t];
+        if (tex.nameLength < 0 || tex.nameOffset + tex.nameLength > file.size ||
+            tex.blockCount > file.size / sizeof(TexelBlock) ||
+            tex.texelOffset + tex.blockCount * sizeof(TexelBlock) > file.size) {
+            return false;
+        }
+        if (!tex.loaded) continue;
+        TextureData expectedTex;
+        if (tex.width <= 0 || tex.height <= 0 ||
+            tex.blockCount != layoutTextureLevels(expectedTex, tex.width, tex.height, tex.layout) ||
+            tex.levelCount != (int)expectedTex.levels.size()) {
+            return false;
+        }
+    }
+    
+    // 三角形、热数据、四叉节点和纹素直接引用映射的各段，不复制；映射是写时复制的，
+    // BVH更新等原位修改只复制被改到的内存页，改变数组长度时才把整个数组复制出来
+    char* data = (char*)file.data;
+    triangleCount = header.triangleCount;
+    triangles.map((Triangle*)(data + header.sections[SECTION_TRIANGLES].offset), triangleCount);
+    reserveTriangles(triangleCount);
+    const char* visible = data + header.sections[SECTION_APPEAR].offset;
+    for (int i = 0; i < triangleCount; i++) appear[i] = visible[i] != 0;
+    const PointLight* lights = (const PointLight*)(data + header.sections[SECTION_LIGHTS].offset);
+    pointLights.assign(lights, lights + header.pointLightCount);
+    lightsDirty = true;
+    
+    triangleIndices.map((int*)(data + header.sections[SECTION_INDICES].offset), header.slotCount);
+    float* geometry = (float*)(data + header.sections[SECTION_GEOMETRY].offset);
+    MappedArray<float>* arrays[9] = {
+        &triGeometry.v0[0], &triGeometry.v0[1], &triGeometry.v0[2],
+        &triGeometry.e1[0], &triGeometry.e1[1], &triGeometry.e1[2],
+        &triGeometry.e2[0], &triGeometry.e2[1], &triGeometry.e2[2]
+    };
+    for (int k = 0; k < 9; k++) arrays[k]->map(geometry + k * slots, slots);
+    wideNodes.map((WideBVHNode*)(data + header.sections[SECTION_WIDE_NODES].offset), header.wideNodeCount);
+    resetBVHUpdate();
+    
+    // 缓存中的纹理在预算内直接常驻，放不下的留到第一次采样时再从原文件解码
+    for (int t = 0; t < header.textureCount; t++) {
+        const SceneCacheTexture& entry = textures[t];
+        int id = registerTexture(string(data + entry.nameOffset, entry.nameLength));
+        if (!entry.loaded || peekTexture(id)) continue;
+        if (textureResidentBytes + entry.blockCount * sizeof(TexelBlock) > textureBudget) continue;
+        TextureData* tex = new TextureData();
+        tex->filename = textureCache[id].filename;
+        layoutTextureLevels(*tex, entry.width, entry.height, entry.layout);
+        tex->storage.map((TexelBlock*)(data + entry.texelOffset), entry.blockCount);
+        tex->loaded = true;
+        installTexture(id, tex);
+    }
+    sceneCacheFile.swap(file);          // 映射保留到releaseScene
+    
+    setSimdLevel(simdLevel);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "场景缓存命中: " << path << "（三角形 " << triangleCount << "，四叉节点 " << wideNodes.size()
+         << "，纹理 " << header.textureCount << "），加载耗时 " << ms << " ms" << endl;
+    cout << "求交内核: " << simdLevelName(simdLevel) << "（CPU支持 "
+         << simdLevelName(detectSimdLevel()) << "）" << endl;
+    return true;
+}
+
+// 关闭场景缓存的映射（场景数组和纹理都释放之后）
+void releaseSceneCache() {
+    sceneCacheFile.close();
+}
+
+// 补齐到对齐边界（bytes为刚写入的段长度）
+void padSceneCache(ofstream& file, size_t bytes) {
+    static const char zeros[SCENE_CACHE_ALIGN] = {0};
+    file.write(zeros, (SCENE_CACHE_ALIGN - bytes % SCENE_CACHE_ALIGN) % SCENE_CACHE_ALIGN);
+}
+
+// 写入一段数据并补齐到对齐边界
+void writeSceneCacheBytes(ofstream& file, const void* data, size_t bytes) {
+    if (bytes > 0) file.write((const char*)data, bytes);
+    padSceneCache(file, bytes);
+}
+
+inline unsigned long long alignSceneCache(unsigned long long offset) {
+    return (offset + SCENE_CACHE_ALIGN - 1) / SCENE_CACHE_ALIGN * SCENE_CACHE_ALIGN;
+}
+
+// 把当前场景（含BVH）写入缓存：先写临时文件再改名，写到一半中断不会留下损坏的缓存
+// 内容哈希需在解析源文件之前算好（见setupScene），解析期间源文件被修改时下次启动会发现不一致
+bool saveSceneCache(const string& path, const SceneCacheKey& key) {
+    if (key.sourceHash == 0 || wideNodes.empty()) return false;
+    
+    SceneCacheHeader header;
+    fillSceneCacheHeader(header);
+    header.paramsHash = key.paramsHash;
+    header.sourceHash = key.sourceHash;
+    memcpy(header.sources, key.sources, sizeof(key.sources));
+    header.triangleCount = triangleCount;
+    header.pointLightCount = pointLights.size();
+    header.slotCount = triangleIndices.size();
+    header.wideNodeCount = wideNodes.size();
+    header.textureCount = textureCache.size();
+    size_t slots = header.slotCount + 4;
+    
+    // 纹理数据段：每个纹理依次为文件名、颜色、透明度，各自对齐
+    unsigned long long bytes[SECTION_COUNT] = {
+        triangleCount * sizeof(Triangle), (unsigned long long)triangleCount,
+        pointLights.size() * sizeof(PointLight), header.slotCount * sizeof(int),
+        9 * slots * sizeof(float), wideNodes.size() * sizeof(WideBVHNode),
+        textureCache.size() * sizeof(SceneCacheTexture), 0
+    };
+    unsigned long long offset = alignSceneCache(sizeof(SceneCacheHeader));
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        header.sections[s].offset = offset;
+        header.sections[s].bytes = bytes[s];
+        offset = alignSceneCache(offset + bytes[s]);
+    }
+    // 纹理按需解码，写缓存时还没采样过的纹理在这里解码（淘汰的纹理在下一帧结束前仍然有效）
+    vector<SceneCacheTexture> textures(textureCache.size());
+    vector<const TextureData*> textureData(textureCache.size());
+    unsigned long long dataStart = header.sections[SECTION_TEXTURE_DATA].offset;
+    offset = dataStart;
+    for (size_t t = 0; t < textureCache.size(); t++) {
+        const TextureData* tex = textureData[t] = getTexture(t);
+        SceneCacheTexture& entry = textures[t];
+        entry.width = tex ? tex->width : 0;
+        entry.height = tex ? tex->height : 0;
+        entry.loaded = tex != nullptr;
+        entry.nameLength = textureCache[t].filename.size();
+        entry.nameOffset = offset;
+        entry.layout = tex ? tex->layout : TEXTURE_LINEAR;
+        entry.levelCount = tex ? tex->levels.size() : 0;
+        entry.blockCount = tex ? tex->storage.size() : 0;
+        entry.texelOffset = offset = alignSceneCache(offset + entry.nameLength);
+        offset = alignSceneCache(offset + entry.blockCount * sizeof(TexelBlock));
+    }
+    header.sections[SECTION_TEXTURE_DATA].bytes = offset - dataStart;
+    
+    string tempPath = path + ".tmp";
+    ofstream file(tempPath, ios::binary);
+    if (!file.is_open()) return false;
+    writeSceneCacheBytes(file, &header, sizeof(header));
+    triangles.forEachChunk(triangleCount, [&](const Triangle* chunk, size_t count) {
+        file.write((const char*)chunk, count * sizeof(Triangle));
+    });
+    padSceneCache(file, bytes[SECTION_TRIANGLES]);
+    writeSceneCacheBytes(file, appear.data(), bytes[SECTION_APPEAR]);
+    writeSceneCacheBytes(file, pointLights.data(), bytes[SECTION_LIGHTS]);
+    writeSceneCacheBytes(file, triangleIndices.data(), bytes[SECTION_INDICES]);
+    const TriangleGeometry& g = triGeometry;
+    const MappedArray<float>* arrays[9] = {&g.v0[0], &g.v0[1], &g.v0[2], &g.e1[0], &g.e1[1], &g.e1[2], &g.e2[0], &g.e2[1], &g.e2[2]};
+    for (int k = 0; k < 9; k++) file.write((const char*)arrays[k]->data(), slots * sizeof(float));
+    padSceneCache(file, bytes[SECTION_GEOMETRY]);
+    writeSceneCacheBytes(file, wideNodes.data(), bytes[SECTION_WIDE_NODES]);
+    writeSceneCacheBytes(file, textures.data(), bytes[SECTION_TEXTURES]);
+    for (size_t t = 0; t < textureCache.size(); t++) {
+        writeSceneCacheBytes(file, textureCache[t].filename.data(), textureCache[t].filename.size());
+        const void* texels = textureData[t] ? textureData[t]->storage.data() : nullptr;
+        writeSceneCacheBytes(file, texels, textures[t].blockCount * sizeof(TexelBlock));
+    }
+    file.close();
+    if (!file) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    
+    remove(path.c_str());
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    cout << "场景缓存已写入: " << path << endl;
+    return true;
+}
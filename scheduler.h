@@ -0,0 +1,153 @@
+// scheduler.cpp - 分块渲染调度：屏幕按Morton顺序切成小块，各线程从自己的队列取块，空闲时从其他线程窃取
+
+#include "vector.h"
+#include <bits/stdc++.h>
+#include <omp.h>
+using namespace std;
+
+const int RENDER_TILE_SIZE = 16;    // 每块的采样点边长（16x16，正好是2x2个光线包）
+
+// 每个线程的工作队列：尚未渲染的块是Morton序列中的一段[begin, end)
+// begin和end打包进一个64位原子量，本线程从前端取块，其他线程用CAS从后端窃取一半
+struct alignas(64) TileQueue {
+    atomic<unsigned long long> range{0};
+};
+
+// 每个线程的渲染统计（最近一帧）
+struct RenderThreadStats {
+    int tiles = 0;          // 渲染的块数
+    int stolen = 0;         // 其中窃取来的块数
+    int steals = 0;         // 成功窃取的次数
+    double busyMs = 0;      // 渲染块所用时间
+};
+
+vector<RenderThreadStats> renderThreadStats;
+double renderFrameMs = 0;   // 最近一帧的墙钟时间
+
+// 块的Morton顺序（屏幕块数变化时重新计算）
+vector<int> tileOrder;
+int tileOrderX = 0, tileOrderY = 0;
+
+inline unsigned long long packRange(unsigned int begin, unsigned int end) {
+    return ((unsigned long long)begin << 32) | end;
+}
+
+// 把16位坐标的各位错开，用于计算Morton码
+inline unsigned int spreadBits(unsigned int v) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+// 按Morton码排列屏幕块，相邻的块在序列中也相邻，一段连续的块在屏幕上大致成方形
+void buildTileOrder(int tilesX, int tilesY) {
+    if (tilesX == tileOrderX && tilesY == tileOrderY) return;
+    tileOrderX = tilesX;
+    tileOrderY = tilesY;
+    
+    vector<pair<unsigned int, int>> codes(tilesX * tilesY);
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            int index = ty * tilesX + tx;
+            codes[index] = make_pair(spreadBits(tx) | (spreadBits(ty) << 1), index);
+        }
+    }
+    sort(codes.begin(), codes.end());
+    
+    tileOrder.resize(codes.size());
+    for (size_t i = 0; i < codes.size(); i++) tileOrder[i] = codes[i].second;
+}
+
+// 从自己的队列前端取一块
+inline bool popTile(TileQueue& queue, int& tile) {
+    unsigned long long r = queue.range.load(memory_order_relaxed);
+    while (true) {
+        unsigned int begin = r >> 32, end = (unsigned int)r;
+        if (begin >= end) return false;
+        if (queue.range.compare_exchange_weak(r, packRange(begin + 1, end))) {
+            tile = begin;
+            return true;
+        }
+    }
+}
+
+// 从其他线程队列后端窃取一半块，第一块直接返回，其余放入自己的队列
+bool stealTiles(vector<TileQueue>& queues, int self, int& tile, RenderThreadStats& stats) {
+    int n = queues.size();
+    for (int k = 1; k < n; k++) {
+        TileQueue& victim = queues[(self + k) % n];
+        unsigned long long r = victim.range.load(memory_order_relaxed);
+        while (true) {
+            unsigned int begin = r >> 32, end = (unsigned int)r;
+            if (begin >= end) break;
+            unsigned int take = (end - begin + 1) / 2;
+            if (victim.range.compare_exchange_weak(r, packRange(begin, end - take))) {
+                tile = end - take;
+                queues[self].range.store(packRange(end - take + 1, end));
+                stats.steals++;
+                stats.stolen += take;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// 并行渲染所有屏幕块：renderTile(x0, y0, x1, y1)渲染像素范围[x0, x1) x [y0, y1)
+// 使用OpenMP线程（运行时在多帧之间复用同一组线程），每个线程先按Morton顺序分到连续的一段块
+template <typename RenderTile>
+void renderTiles(int STEP, RenderTile renderTile) {
+    int tileSpan = RENDER_TILE_SIZE * STEP;
+    int tilesX = (screenWidth + tileSpan - 1) / tileSpan;
+    int tilesY = (screenHeight + tileSpan - 1) / tileSpan;
+    buildTileOrder(tilesX, tilesY);
+    
+    int threadCount = omp_get_max_threads();
+    int tileCount = tileOrder.size();
+    vector<TileQueue> queues(threadCount);
+    for (int t = 0; t < threadCount; t++) {
+        queues[t].range.store(packRange((long long)tileCount * t / threadCount,
+                                        (long long)tileCount * (t + 1) / threadCount));
+    }
+    renderThreadStats.assign(threadCount, RenderThreadStats());
+    
+    auto frameStart = chrono::steady_clock::now();
+    #pragma omp parallel num_threads(threadCount)
+    {
+        int self = omp_get_thread_num();
+        RenderThreadStats stats;
+        int tile;
+        
+        while (popTile(queues[self], tile) || stealTiles(queues, self, tile, stats)) {
+            auto start = chrono::steady_clock::now();
+            int index = tileOrder[tile];
+            int x0 = index % tilesX * tileSpan, y0 = index / tilesX * tileSpan;
+            renderTile(x0, y0, min(x0 + tileSpan, screenWidth), min(y0 + tileSpan, screenHeight));
+            stats.busyMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            stats.tiles++;
+        }
+        
+        renderThreadStats[self] = stats;
+    }
+    releaseRetiredTextures();   // 所有线程都已结束采样，本帧淘汰的纹理可以释放
+    renderFrameMs = chrono::duration<double, milli>(chrono::steady_clock::now() - frameStart).count();
+}
+
+// 打印最近一帧各线程的利用率（渲染时间 / 帧时间）
+void printRenderThreadStats() {
+    double minUtil = 1e9, sumUtil = 0;
+    for (size_t t = 0; t < renderThreadStats.size(); t++) {
+        const RenderThreadStats& s = renderThreadStats[t];
+        double util = renderFrameMs > 0 ? s.busyMs / renderFrameMs * 100.0 : 0;
+        minUtil = min(minUtil, util);
+        sumUtil += util;
+        cout << "  线程 " << t << ": " << s.tiles << " 块（窃取 " << s.stolen << " 块/" << s.steals
+             << " 次），渲染 " << s.busyMs << " ms，利用率 " << util << "%" << endl;
+    }
+    if (!renderThreadStats.empty()) {
+        cout << "  平均利用率 " << sumUtil / renderThreadStats.size() << "%，最低 " << minUtil << "%" << endl;
+    }
+}
@@ -0,0 +1,189 @@
+// texture_cache.cpp - 纹理管理：注册时只记录文件名，第一次采样时解码，常驻纹理超出内存预算时按最近最少使用淘汰
+
+#include "vector.h"
+#include <bits/stdc++.h>
+#include <omp.h>
+using namespace std;
+
+// 一个已注册的纹理
+// data在渲染线程之间无锁读取；解码和淘汰只替换指针，被淘汰的数据到帧结束（没有线程再持有指针）时才释放
+struct TextureSlot {
+    string filename;
+    atomic<TextureData*> data{nullptr};         // 常驻的解码结果，未解码或已淘汰时为空
+    atomic<unsigned int> lastUse{0};            // 最近一次采样时的纹理时钟，用于挑选淘汰对象
+    mutex decodeLock;                           // 同一纹理只由一个线程解码，其他线程等待结果
+    bool failed = false;                        // 解码失败过（之后采样时忽略，不再重试）
+    size_t bytes = 0;                           // 常驻数据的大小
+};
+
+// 纹理访问统计
+struct TextureStats {
+    long long hits = 0;         // 采样时纹理已常驻
+    long long misses = 0;       // 采样时需要解码
+    long long evictions = 0;    // 因超出预算被淘汰的纹理数
+    size_t residentBytes = 0;   // 当前常驻纹理的总大小
+};
+
+size_t textureBudget = (size_t)512 << 20;  // 常驻纹理的内存预算（字节），单个纹理超过预算时仍会常驻
+
+// 纹理表（下标即纹理编号）；用deque保证注册新纹理时已有的槽位不移动
+// 注册只在加载场景时（单线程）进行，渲染期间只读
+deque<TextureSlot> textureCache;
+unordered_map<string, int> textureIds;      // 文件名 -> 纹理编号，只在加载时使用
+
+mutex textureLock;                          // 保护常驻大小、淘汰和待释放列表
+size_t textureResidentBytes = 0;
+long long textureEvictions = 0;
+vector<TextureData*> retiredTextures;       // 已淘汰、等待帧结束时释放的纹理
+atomic<unsigned int> textureClock{1};       // 每次解码和每帧结束时前进一格，同一格内的采样视为同时发生
+
+// 各线程的命中/未命中计数（避免所有线程争用同一个计数器）
+thread_local long long threadTextureHits = 0, threadTextureMisses = 0;
+
+// 注册纹理，返回纹理编号（同名纹理只注册一次，第一次采样时解码）
+int registerTexture(const string& filename) {
+    auto it = textureIds.find(filename);
+    if (it != textureIds.end()) return it->second;
+    
+    int id = textureCache.size();
+    textureCache.emplace_back();
+    textureCache[id].filename = filename;
+    textureIds[filename] = id;
+    return id;
+}
+
+// 纹理文件是否可用（已常驻或文件可读），不解码
+bool textureAvailable(int id) {
+    if (id < 0 || id >= (int)textureCache.size() || textureCache[id].failed) return false;
+    if (textureCache[id].data.load(memory_order_acquire)) return true;
+    FILE* file = fopen(textureCache[id].filename.c_str(), "rb");
+    if (!file) return false;
+    fclose(file);
+    return true;
+}
+
+// 已常驻的纹理大小
+inline size_t textureBytes(const TextureData& tex) {
+    return tex.storage.size() * sizeof(TexelBlock) + sizeof(TextureData);
+}
+
+// 把解码好的纹理放入槽位，超出预算时淘汰最久未采样的其他纹理（调用时持有textureLock）
+void makeTextureResident(int id, TextureData* tex) {
+    TextureSlot& slot = textureCache[id];
+    slot.bytes = textureBytes(*tex);
+    slot.lastUse.store(textureClock.load(memory_order_relaxed), memory_order_relaxed);
+    slot.data.store(tex, memory_order_release);
+    textureResidentBytes += slot.bytes;
+    
+    while (textureResidentBytes > textureBudget) {
+        int victim = -1;
+        unsigned int oldest = UINT_MAX;
+        for (int t = 0; t < (int)textureCache.size(); t++) {
+            if (t == id || !textureCache[t].data.load(memory_order_relaxed)) continue;
+            unsigned int use = textureCache[t].lastUse.load(memory_order_relaxed);
+            if (use < oldest) {
+                oldest = use;
+                victim = t;
+            }
+        }
+        if (victim < 0) break;
+        
+        TextureSlot& evicted = textureCache[victim];
+        retiredTextures.push_back(evicted.data.exchange(nullptr, memory_order_acq_rel));
+        textureResidentBytes -= evicted.bytes;
+        evicted.bytes = 0;
+        textureEvictions++;
+    }
+}
+
+// 按编号取纹理（常驻时O(1)无锁），第一次采样或已被淘汰时在当前线程解码；无纹理或解码失败时返回空
+// 返回的指针在本帧内有效（淘汰的数据在releaseRetiredTextures时才释放）
+const TextureData* getTexture(int id) {
+    if (id < 0 || id >= (int)textureCache.size()) return nullptr;
+    TextureSlot& slot = textureCache[id];
+    TextureData* tex = slot.data.load(memory_order_acquire);
+    unsigned int now = textureClock.load(memory_order_relaxed);
+    if (tex) {
+        threadTextureHits++;
+        if (slot.lastUse.load(memory_order_relaxed) != now) slot.lastUse.store(now, memory_order_relaxed);
+        return tex;
+    }
+    
+    lock_guard<mutex> decode(slot.decodeLock);
+    tex = slot.data.load(memory_order_acquire);
+    if (tex) {
+        threadTextureHits++;       // 等待期间其他线程已解码完成
+        return tex;
+    }
+    if (slot.failed) return nullptr;
+    
+    threadTextureMisses++;
+    textureClock.fetch_add(1, memory_order_relaxed);
+    tex = new TextureData();
+    tex->filename = slot.filename;
+    if (!loadPNGTexture(MultiByteToWide(slot.filename).c_str(), *tex)) {
+        delete tex;
+        slot.failed = true;
+        return nullptr;
+    }
+    
+    lock_guard<mutex> guard(textureLock);
+    makeTextureResident(id, tex);
+    return tex;
+}
+
+// 取已常驻的纹理，不解码也不计入统计
+const TextureData* peekTexture(int id) {
+    if (id < 0 || id >= (int)textureCache.size()) return nullptr;
+    return textureCache[id].data.load(memory_order_acquire);
+}
+
+// 直接放入已解码的纹理（从场景缓存加载时），纹理已常驻时丢弃tex
+void installTexture(int id, TextureData* tex) {
+    TextureSlot& slot = textureCache[id];
+    lock_guard<mutex> decode(slot.decodeLock);
+    if (slot.data.load(memory_order_acquire)) {
+        delete tex;
+        return;
+    }
+    lock_guard<mutex> guard(textureLock);
+    makeTextureResident(id, tex);
+}
+
+// 释放已淘汰的纹理：只能在没有渲染线程持有纹理指针时调用（每帧渲染结束后）
+void releaseRetiredTextures() {
+    textureClock.fetch_add(1, memory_order_relaxed);
+    lock_guard<mutex> guard(textureLock);
+    for (size_t i = 0; i < retiredTextures.size(); i++) delete retiredTextures[i];
+    retiredTextures.clear();
+}
+
+// 释放所有纹理数据（程序退出时），纹理仍保持注册
+void releaseTextures() {
+    releaseRetiredTextures();
+    for (size_t t = 0; t < textureCache.size(); t++) {
+        delete textureCache[t].data.exchange(nullptr);
+        textureCache[t].bytes = 0;
+    }
+    textureResidentBytes = 0;
+}
+
+// 汇总并清零各线程的命中/未命中计数，返回自上次调用以来的统计
+TextureStats collectTextureStats() {
+    TextureStats stats;
+    long long hits = 0, misses = 0;
+    #pragma omp parallel reduction(+:hits, misses)
+    {
+        hits += threadTextureHits;
+        misses += threadTextureMisses;
+        threadTextureHits = threadTextureMisses = 0;
+    }
+    stats.hits = hits;
+    stats.misses = misses;
+    
+    lock_guard<mutex> guard(textureLock);
+    stats.evictions = textureEvictions;
+    stats.residentBytes = textureResidentBytes;
+    textureEvictions = 0;
+    return stats;
+}
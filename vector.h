@@ -1,223 +1,486 @@
-// vector.h - άͼϵͳݽṹ뺯
-
-#pragma once
-#include <bits/stdc++.h>
-#include <graphics.h>
-using namespace std;
-
-#ifndef VECTOR_H
-#define VECTOR_H
-
-// ڳߴ糣
-const int WIDTH = 800;
-const int HEIGHT = 600;
-const double PI = 3.1415926535;
-
-// άṹ
-struct Point3D { 
-    double x, y, z; 
-};
-
-// νṹ֧ӳ䣩
-struct Triangle {
-    Point3D points[3];      // 
-    COLORREF color;         // ɫʱʹã
-    int materialType;       // ͣ1-䣬2-͸
-    bool is_image;          // Ƿͼ
-    string image;           // ļ·
-    double x[3], y[3];      //  (u, v) Ӧÿ
-};
-
-// ߽ṹ
-struct Ray {
-    double origin[3];
-    double direction[3];
-};
-
-// м¼
-struct HitRecord {
-    double t;               // ߲
-    double position[3];     // е
-    double normal[3];       // 
-    COLORREF color;         // ɫ
-    int materialType;       // 
-    double tex_u, tex_v;    // 
-    bool hasTexture;        // Ƿ
-    string texturePath;     // ·
-    bool hit = false;       // Ƿ
-};
-
-// ṹ
-struct Camera {
-    double x = 0, y = 1, z = 0;    // λ
-    double yaw = 0, pitch = 0;     // ƫǺ͸
-    double speed = 1.0;            // ƶٶ
-    double sensitivity = 0.008;    // 
-};
-
-// Դṹ
-struct PointLight {
-    double position[3];     // Դλ
-    double color[3];        // RGBɫ
-    double intensity;       // ǿ
-    double radius;          // Դ뾶Ӱ
-};
-
-// BVHΧвνṹض
-struct AABB {
-    double min[3];
-    double max[3];
-    
-    AABB() {
-        min[0] = min[1] = min[2] = 1e9;
-        max[0] = max[1] = max[2] = -1e9;
-    }
-};
-
-struct BVHNode {
-    AABB bbox;
-    BVHNode* left;
-    BVHNode* right;
-    int startIndex;
-    int endIndex;
-    bool isLeaf;
-    
-    BVHNode() : left(nullptr), right(nullptr), isLeaf(false) {}
-};
-
-// ȫֱ
-extern Triangle triangles[1000001];
-extern bitset<1000001> appear;
-extern int triangleCount;
-extern COLORREF flash_screen[WIDTH][HEIGHT];
-extern Camera camera;
-extern PointLight pointLights[10];
-extern int pointLightCount;
-extern BVHNode* bvhRoot;
-extern vector<int> triangleIndices;
-
-// 
-void addTriangleWithNoTexture(Point3D a, Point3D b, Point3D c, 
-                             COLORREF color, int matType = 1);
-void addTriangleWithTexture(Point3D a, Point3D b, Point3D c, 
-                           string texturePath, 
-                           double u1, double v1,
-                           double u2, double v2,
-                           double u3, double v3,
-                           int matType = 1);
-void addPointLight(double x, double y, double z, 
-                   double r, double g, double b, 
-                   double intensity = 1.0, double radius = 0.0);
-double calculateAttenuation(double distance, double intensity, 
-                          double lightPos[3], double hitPos[3], double lightRadius);
-double dot(double a[3], double b[3]);
-void cross(double a[3], double b[3], double result[3]);
-void subtract(double a[3], double b[3], double result[3]);
-void normalize(double v[3]);
-// vector.cpp - άͼϵͳĺʵ
-
-
-// ȫֱ
-Triangle triangles[1000001];
-bitset<1000001> appear;
-int triangleCount = 0;
-COLORREF flash_screen[WIDTH][HEIGHT];
-Camera camera;
-PointLight pointLights[10];
-int pointLightCount = 0;
-BVHNode* bvhRoot = nullptr;
-vector<int> triangleIndices;
-
-// 
-void addTriangleWithNoTexture(Point3D a, Point3D b, Point3D c, 
-                             COLORREF color, int matType) {
-    if (triangleCount >= 1000000) {
-        cout << "Error: Triangle array full!" << endl;
-        return;
-    }
-    
-    triangles[triangleCount].points[0] = a;
-    triangles[triangleCount].points[1] = b;
-    triangles[triangleCount].points[2] = c;
-    triangles[triangleCount].is_image = false;
-    triangles[triangleCount].materialType = matType;
-    triangles[triangleCount].color = color;
-    appear[triangleCount] = 1;
-    triangleCount++;
-}
-
-// Ӵ
-void addTriangleWithTexture(Point3D a, Point3D b, Point3D c, 
-                           string texturePath, 
-                           double u1, double v1,
-                           double u2, double v2,
-                           double u3, double v3,
-                           int matType) {
-    if (triangleCount >= 1000000) {
-        cout << "Error: Triangle array full!" << endl;
-        return;
-    }
-    
-    triangles[triangleCount].points[0] = a;
-    triangles[triangleCount].points[1] = b;
-    triangles[triangleCount].points[2] = c;
-    triangles[triangleCount].is_image = true;
-    triangles[triangleCount].image = texturePath;
-    triangles[triangleCount].x[0] = u1; triangles[triangleCount].y[0] = v1;
-    triangles[triangleCount].x[1] = u2; triangles[triangleCount].y[1] = v2;
-    triangles[triangleCount].x[2] = u3; triangles[triangleCount].y[2] = v3;
-    triangles[triangleCount].materialType = matType;
-    triangles[triangleCount].color = RGB(255, 255, 255);
-    appear[triangleCount] = 1;
-    triangleCount++;
-}
-
-// ӵԴ
-void addPointLight(double x, double y, double z, 
-                   double r, double g, double b, 
-                   double intensity, double radius) {
-    if (pointLightCount >= 10) {
-        cout << "Error: Too many point lights!" << endl;
-        return;
-    }
-    
-    pointLights[pointLightCount].position[0] = x;
-    pointLights[pointLightCount].position[1] = y;
-    pointLights[pointLightCount].position[2] = z;
-    pointLights[pointLightCount].color[0] = r;
-    pointLights[pointLightCount].color[1] = g;
-    pointLights[pointLightCount].color[2] = b;
-    pointLights[pointLightCount].intensity = intensity;
-    pointLights[pointLightCount].radius = radius;
-    pointLightCount++;
-}
-
-// 
-double dot(double a[3], double b[3]) {
-    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
-}
-
-// 
-void cross(double a[3], double b[3], double result[3]) {
-    result[0] = a[1] * b[2] - a[2] * b[1];
-    result[1] = a[2] * b[0] - a[0] * b[2];
-    result[2] = a[0] * b[1] - a[1] * b[0];
-}
-
-// 
-void subtract(double a[3], double b[3], double result[3]) {
-    result[0] = a[0] - b[0];
-    result[1] = a[1] - b[1];
-    result[2] = a[2] - b[2];
-}
-
-// һ
-void normalize(double v[3]) {
-    double length = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
-    if (length > 0) {
-        v[0] /= length;
-        v[1] /= length;
-        v[2] /= length;
-    }
-}
-#endif // VECTOR_H
+// vector.h - 三维图形系统核心数据结构与函数声明
+
+#pragma once
+#include <bits/stdc++.h>
+
+// 非Windows平台没有EasyX，只能使用无窗口（离线）渲染模式
+#if !defined(_WIN32) && !defined(HEADLESS)
+#define HEADLESS
+#endif
+
+#ifndef HEADLESS
+#include <graphics.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+// 补齐渲染核心用到的GDI类型和颜色宏（与windows.h定义一致）
+typedef unsigned int COLORREF;
+typedef unsigned char BYTE;
+#define RGB(r, g, b) ((COLORREF)(((BYTE)(r)) | (((COLORREF)(BYTE)(g)) << 8) | (((COLORREF)(BYTE)(b)) << 16)))
+#define GetRValue(rgb) ((BYTE)(rgb))
+#define GetGValue(rgb) ((BYTE)(((rgb) >> 8) & 0xFF))
+#define GetBValue(rgb) ((BYTE)(((rgb) >> 16) & 0xFF))
+#endif
+using namespace std;
+
+#ifndef VECTOR_H
+#define VECTOR_H
+
+// 窗口尺寸常量（默认分辨率）
+const int WIDTH = 800;
+const int HEIGHT = 600;
+const double PI = 3.1415926535;
+
+// 三维点结构
+struct Point3D { 
+    double x, y, z; 
+};
+
+// 三角形结构（支持纹理映射）
+// 作为冷数据（颜色、材质、纹理）按三角形编号访问；求交只使用TriangleGeometry
+struct Triangle {
+    Point3D points[3];      // 三个顶点坐标
+    COLORREF color;         // 基础颜色（无纹理时使用）
+    int materialType;       // 材质类型：1-漫反射，2-半透明
+    int textureId;          // 纹理编号（textureCache下标），-1表示无纹理
+    double x[3], y[3];      // 纹理坐标 (u, v) 对应每个顶点
+};
+
+// 可以直接引用外部内存（映射的场景缓存）的数组，常用接口与vector相同
+// 引用外部内存时按下标读写都不复制（映射是写时复制的，修改只落在本进程的内存页上），第一次改变长度时才复制为自有数据
+template <typename T>
+struct MappedArray {
+    vector<T> owned;
+    T* items = nullptr;     // owned.data()或外部内存
+    size_t count = 0;
+    bool external = false;
+    
+    MappedArray() {}
+    MappedArray(const MappedArray& other) : owned(other.begin(), other.end()) { sync(); }     // 复制出自有数据
+    MappedArray(MappedArray&& other) noexcept { swap(other); }
+    MappedArray& operator=(MappedArray other) noexcept { swap(other); return *this; }
+    
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+    T* data() { return items; }
+    const T* data() const { return items; }
+    T* begin() { return items; }
+    T* end() { return items + count; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    
+    // 引用外部的n个元素（调用者保证数组使用期间这段内存有效），原有内容丢弃
+    void map(T* data, size_t n) {
+        release();
+        items = data;
+        count = n;
+        external = true;
+    }
+    
+    // 改变长度前取得自有的vector（引用外部内存时在这里复制），改完后sync
+    vector<T>& own() {
+        if (external) {
+            owned.assign(items, items + count);
+            external = false;
+        }
+        return owned;
+    }
+    void sync() {
+        items = owned.data();
+        count = owned.size();
+    }
+    
+    void resize(size_t n, const T& value = T()) { own().resize(n, value); sync(); }
+    void reserve(size_t n) { own().reserve(n); sync(); }
+    void push_back(const T& value) { own().push_back(value); sync(); }
+    void assign(size_t n, const T& value) {
+        external = false;
+        owned.assign(n, value);
+        sync();
+    }
+    void clear() {
+        external = false;
+        owned.clear();
+        sync();
+    }
+    T* erase(T* first, T* last) {
+        size_t a = first - items, b = last - items;
+        own().erase(owned.begin() + a, owned.begin() + b);
+        sync();
+        return items + a;
+    }
+    void swap(vector<T>& other) { own().swap(other); sync(); }
+    void swap(MappedArray& other) noexcept {
+        owned.swap(other.owned);    // vector交换不移动元素，items仍然有效
+        std::swap(items, other.items);
+        std::swap(count, other.count);
+        std::swap(external, other.external);
+    }
+    void release() {
+        vector<T>().swap(owned);
+        items = nullptr;
+        count = 0;
+        external = false;
+    }
+};
+
+// 三角形热数据（结构体数组，按BVH叶子顺序存放，下标与triangleIndices一致）
+// 遍历和求交只访问这些float数组，不触及Triangle中的冷数据（颜色、材质、纹理坐标）
+struct TriangleGeometry {
+    MappedArray<float> v0[3];   // 第一个顶点
+    MappedArray<float> e1[3];   // 边 v1 - v0
+    MappedArray<float> e2[3];   // 边 v2 - v0
+};
+
+// 光线结构
+struct Ray {
+    double origin[3];
+    double direction[3];
+    double coneWidth = 0;   // 光线锥在起点处的宽度（用于纹理LOD）
+    double coneSpread = 0;  // 光线锥的扩散角（弧度）
+};
+
+// 光线命中记录
+// 遍历过程中只更新t、prim和重心坐标，其余字段在遍历结束后由resolveHit填写
+struct HitRecord {
+    double t;               // 光线参数
+    int prim;               // 命中三角形在热数据中的位置（所在BVH的indices下标）
+    int instance = -1;      // 命中的网格实例编号，-1表示场景BVH中的三角形
+    int triangle;           // 命中三角形的编号
+    double area;            // 命中三角形在世界空间中面积的两倍（纹理LOD使用）
+    double baryU, baryV;    // 重心坐标
+    double position[3];     // 命中点坐标
+    double normal[3];       // 法线向量
+    COLORREF color;         // 表面颜色
+    int materialType;       // 材质类型
+    double tex_u, tex_v;    // 纹理坐标
+    int textureId;          // 纹理编号，-1表示无纹理
+    bool hit = false;       // 是否命中
+};
+
+// 相机结构
+struct Camera {
+    double x = 0, y = 1, z = 0;    // 位置
+    double yaw = 0, pitch = 0;     // 偏航角和俯仰角
+    double fov = PI / 3.0;         // 垂直视场角（弧度）
+    double speed = 1.0;            // 移动速度
+    double sensitivity = 0.008;    // 鼠标灵敏度
+};
+
+// 点光源结构
+struct PointLight {
+    double position[3];     // 光源位置
+    double color[3];        // RGB颜色
+    double intensity;       // 强度
+    double radius;          // 光源半径（用于软阴影）
+};
+
+// BVH（包围盒层次结构）相关定义
+struct AABB {
+    double min[3];
+    double max[3];
+    
+    AABB() {
+        min[0] = min[1] = min[2] = 1e9;
+        max[0] = max[1] = max[2] = -1e9;
+    }
+};
+
+// BVH构建节点（构建完成后展开为线性数组）
+// 节点从节点池分配并在重建间复用，所有字段由buildBVH填写
+struct BVHNode {
+    AABB bbox;
+    BVHNode* left;          // 两个子节点在池中相邻，right == left + 1
+    BVHNode* right;
+    int startIndex;
+    int endIndex;
+    int axis;               // 划分轴
+    int nodeCount;          // 子树节点总数（用于展开时计算位置）
+    bool isLeaf;
+};
+
+// BVH构建参数
+struct BVHBuildConfig {
+    int maxLeafSize = 4;            // 叶子节点最多三角形数
+    int maxDepth = 64;              // 最大深度（受遍历栈大小限制）
+    int binCount = 16;              // SAH分桶数量
+    double traversalCost = 1.0;     // 遍历一个节点的代价（相对一次三角形测试）
+};
+
+const int BVH_STACK_SIZE = 128;     // 遍历栈大小
+const int MAX_LEAF_TRIANGLES = 65535;   // 叶子三角形数上限（节点中count为unsigned short）
+
+// 线性BVH节点：按深度优先顺序存放，第一个子节点紧跟父节点，第二个子节点记录下标
+struct alignas(32) LinearBVHNode {
+    float bmin[3];          // 包围盒（向外舍入到float）
+    float bmax[3];
+    int offset;             // 叶子：triangleIndices起始位置；内部节点：第二个子节点下标
+    unsigned short count;   // 叶子中的三角形数量，0表示内部节点
+    unsigned char axis;     // 内部节点的划分轴
+    unsigned char pad;
+};
+
+// 四叉BVH节点：由线性BVH折叠而成，四个子节点包围盒按SoA存放，便于SIMD一次测试四个
+struct alignas(64) WideBVHNode {
+    float bmin[3][4];       // bmin[轴][子节点]，空子节点为反转的包围盒
+    float bmax[3][4];
+    int child[4];           // 叶子：triangleIndices起始位置；内部节点：四叉节点下标；空子节点为-1
+    unsigned short count[4]; // 叶子中的三角形数量，0表示内部节点
+};
+
+// 一棵四叉BVH及其三角形热数据：场景BVH（sceneBVH）和每个实例化网格各有一棵
+struct WideBVH {
+    MappedArray<WideBVHNode> nodes;     // 四叉节点，0为根
+    MappedArray<int> indices;           // 槽位到三角形编号
+    TriangleGeometry geometry;          // 按槽位存放的三角形热数据
+};
+
+// 光源面采样使用的序列
+enum LightSamplerType {
+    SAMPLER_RANDOM = 0,     // 分层抖动随机数
+    SAMPLER_SOBOL = 1       // 扰动Sobol低差异序列
+};
+
+// 求交内核使用的指令集级别
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE = 1,
+    SIMD_AVX2 = 2
+};
+
+// 分块数组：元素按固定大小的块分配，增长时只追加新块、不移动已有元素（引用一直有效），release一次归还全部块
+// 增长只能在不渲染时进行（块表本身可能重新分配）；整块可以直接引用外部内存（映射的场景缓存），这些块不归还
+template <typename T, int CHUNK_BITS>
+struct ChunkedArray {
+    static const size_t CHUNK_SIZE = (size_t)1 << CHUNK_BITS;
+    vector<T*> chunks;                      // 各块的首元素
+    vector<unique_ptr<T[]>> ownedChunks;    // 自己分配的块
+    
+    T& operator[](size_t i) { return chunks[i >> CHUNK_BITS][i & (CHUNK_SIZE - 1)]; }
+    const T& operator[](size_t i) const { return chunks[i >> CHUNK_BITS][i & (CHUNK_SIZE - 1)]; }
+    size_t capacity() const { return chunks.size() << CHUNK_BITS; }
+    size_t bytes() const { return capacity() * sizeof(T); }
+    
+    // 保证至少能容纳n个元素（新块清零）
+    void reserve(size_t n) {
+        while (capacity() < n) {
+            ownedChunks.emplace_back(new T[CHUNK_SIZE]());
+            chunks.push_back(ownedChunks.back().get());
+        }
+    }
+    
+    void release() {
+        vector<T*>().swap(chunks);
+        vector<unique_ptr<T[]>>().swap(ownedChunks);
+    }
+    
+    // 按块访问前n个元素：fn(块内首元素指针, 元素个数)
+    template <typename F>
+    void forEachChunk(size_t n, F fn) const {
+        for (size_t i = 0; i < n; i += CHUNK_SIZE) fn(chunks[i >> CHUNK_BITS], min(CHUNK_SIZE, n - i));
+    }
+    
+    // 前n个元素直接引用外部的连续数组（原有内容丢弃）；只引用满的块，
+    // 最后不满一块的部分复制到自己分配的块，之后追加的元素不会写到外部数组之外
+    void map(T* data, size_t n) {
+        release();
+        size_t full = n >> CHUNK_BITS;
+        for (size_t c = 0; c < full; c++) chunks.push_back(data + (c << CHUNK_BITS));
+        if (n > (full << CHUNK_BITS)) {
+            reserve(n);
+            memcpy(chunks.back(), data + (full << CHUNK_BITS), (n - (full << CHUNK_BITS)) * sizeof(T));
+        }
+    }
+};
+
+template <typename T, int CHUNK_BITS>
+const size_t ChunkedArray<T, CHUNK_BITS>::CHUNK_SIZE;
+
+// 全局变量声明
+extern ChunkedArray<Triangle, 14> triangles;
+extern vector<char> appear;
+extern int triangleCount;
+extern int screenWidth, screenHeight;
+extern vector<COLORREF> flash_screen;
+extern Camera camera;
+extern vector<PointLight> pointLights;
+extern bool lightsDirty;
+extern vector<LinearBVHNode> bvhNodes;
+extern WideBVH sceneBVH;
+extern MappedArray<WideBVHNode>& wideNodes;
+extern int simdLevel;
+extern bool packetTracing;
+extern int lightSampler;
+extern unsigned int sampleFrame;
+extern bool progressiveMode;
+extern bool reprojectionEnabled;
+extern BVHBuildConfig bvhConfig;
+extern MappedArray<int>& triangleIndices;
+extern vector<char> removedTriangles;
+extern vector<char> meshTriangles;
+extern TriangleGeometry& triGeometry;
+
+// 函数声明
+void reserveTriangles(int count);
+void releaseScene();
+void releaseSceneCache();
+int registerTexture(const string& filename);
+bool textureAvailable(int id);
+void addTriangleWithNoTexture(Point3D a, Point3D b, Point3D c, 
+                             COLORREF color, int matType = 1);
+void addTriangleWithTexture(Point3D a, Point3D b, Point3D c, 
+                           string texturePath, 
+                           double u1, double v1,
+                           double u2, double v2,
+                           double u3, double v3,
+                           int matType = 1);
+void addPointLight(double x, double y, double z, 
+                   double r, double g, double b, 
+                   double intensity = 1.0, double radius = 0.0);
+double calculateAttenuation(double distance, double intensity, 
+                          double lightPos[3], double hitPos[3], 
+                          double normal[3], double lightRadius);
+bool occludedScene(const Ray& ray, double tMax, bool* partial = nullptr);
+double dot(double a[3], double b[3]);
+void cross(double a[3], double b[3], double result[3]);
+void subtract(double a[3], double b[3], double result[3]);
+void normalize(double v[3]);
+void buildWideBVH();
+void releaseBVH();
+void resetBVHUpdate();
+Ray generateRay(int x, int y);
+bool intersectScene(Ray ray, HitRecord& hit);
+COLORREF traceRay(Ray ray, int depth);
+COLORREF shadeHit(Ray ray, int depth, HitRecord& hit);
+void fillBlock(int x, int y, int STEP, COLORREF color);
+void renderFrame(int step);
+bool setupScene(const char* objFile, const char* textureFile);
+// vector.cpp - 三维图形系统核心函数实现
+
+
+// 全局变量定义
+ChunkedArray<Triangle, 14> triangles;            // 场景三角形，每块16384个，按需增长
+vector<char> appear;                             // 三角形是否可见，长度与triangles的容量一致
+int triangleCount = 0;
+int screenWidth = WIDTH, screenHeight = HEIGHT;
+vector<COLORREF> flash_screen(WIDTH * HEIGHT);   // 帧缓冲，按 y * screenWidth + x 存储
+thread_local long long threadRayCount = 0;       // 当前线程追踪的光线数（用于统计吞吐量）
+Camera camera;
+vector<PointLight> pointLights;
+bool lightsDirty = false;                        // 光源增删或改动过，下次updateLightBVH时重建光源BVH
+vector<LinearBVHNode> bvhNodes;
+WideBVH sceneBVH;                                // 场景BVH（不含实例化网格的三角形）
+MappedArray<WideBVHNode>& wideNodes = sceneBVH.nodes;
+int simdLevel = -1;                              // -1表示按CPU自动选择
+bool packetTracing = true;                       // 主光线按8x8光线包遍历BVH
+int lightSampler = SAMPLER_RANDOM;                // 软阴影采样序列
+unsigned int sampleFrame = 0;                    // 随机数种子中的帧号
+bool progressiveMode = true;                     // 窗口模式下相机静止时渐进累积
+bool reprojectionEnabled = true;                 // 窗口模式下相机移动时复用上一帧的着色
+BVHBuildConfig bvhConfig;
+MappedArray<int>& triangleIndices = sceneBVH.indices;
+vector<char> removedTriangles;                   // 已从场景删除的三角形（编号保留，不再进入BVH）
+vector<char> meshTriangles;                      // 属于实例化网格的三角形（只进入网格自己的BVH）
+TriangleGeometry& triGeometry = sceneBVH.geometry;
+
+// 保证三角形数组（及可见性数组）至少能容纳count个三角形，已有三角形不移动
+void reserveTriangles(int count) {
+    triangles.reserve(count);
+    if (appear.size() < triangles.capacity()) appear.resize(triangles.capacity(), 0);
+}
+
+// 一次性释放场景的三角形、可见性和光源
+void releaseScene() {
+    triangles.release();
+    vector<char>().swap(appear);
+    vector<PointLight>().swap(pointLights);
+    lightsDirty = true;
+    vector<char>().swap(removedTriangles);
+    vector<char>().swap(meshTriangles);
+    triangleCount = 0;
+    releaseSceneCache();
+}
+
+// 添加无纹理三角形
+void addTriangleWithNoTexture(Point3D a, Point3D b, Point3D c, 
+                             COLORREF color, int matType) {
+    reserveTriangles(triangleCount + 1);
+    triangles[triangleCount].points[0] = a;
+    triangles[triangleCount].points[1] = b;
+    triangles[triangleCount].points[2] = c;
+    triangles[triangleCount].textureId = -1;
+    triangles[triangleCount].materialType = matType;
+    triangles[triangleCount].color = color;
+    appear[triangleCount] = 1;
+    triangleCount++;
+}
+
+// 添加带纹理的三角形
+void addTriangleWithTexture(Point3D a, Point3D b, Point3D c, 
+                           string texturePath, 
+                           double u1, double v1,
+                           double u2, double v2,
+                           double u3, double v3,
+                           int matType) {
+    reserveTriangles(triangleCount + 1);
+    triangles[triangleCount].points[0] = a;
+    triangles[triangleCount].points[1] = b;
+    triangles[triangleCount].points[2] = c;
+    triangles[triangleCount].textureId = registerTexture(texturePath);
+    triangles[triangleCount].x[0] = u1; triangles[triangleCount].y[0] = v1;
+    triangles[triangleCount].x[1] = u2; triangles[triangleCount].y[1] = v2;
+    triangles[triangleCount].x[2] = u3; triangles[triangleCount].y[2] = v3;
+    triangles[triangleCount].materialType = matType;
+    triangles[triangleCount].color = RGB(255, 255, 255);
+    appear[triangleCount] = 1;
+    triangleCount++;
+}
+
+// 添加点光源
+void addPointLight(double x, double y, double z, 
+                   double r, double g, double b, 
+                   double intensity, double radius) {
+    PointLight light;
+    light.position[0] = x;
+    light.position[1] = y;
+    light.position[2] = z;
+    light.color[0] = r;
+    light.color[1] = g;
+    light.color[2] = b;
+    light.intensity = intensity;
+    light.radius = radius;
+    pointLights.push_back(light);
+    lightsDirty = true;
+}
+
+// 向量点积
+double dot(double a[3], double b[3]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// 向量叉积
+void cross(double a[3], double b[3], double result[3]) {
+    result[0] = a[1] * b[2] - a[2] * b[1];
+    result[1] = a[2] * b[0] - a[0] * b[2];
+    result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// 向量减法
+void subtract(double a[3], double b[3], double result[3]) {
+    result[0] = a[0] - b[0];
+    result[1] = a[1] - b[1];
+    result[2] = a[2] - b[2];
+}
+
+// 向量归一化
+void normalize(double v[3]) {
+    double length = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+#endif // VECTOR_H
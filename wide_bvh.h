@@ -0,0 +1,432 @@
+// wide_bvh.cpp - 四叉BVH与SIMD求交内核（SSE测试子节点包围盒，AVX2测试叶子三角形）
+
+#include "vector.h"
+#include <bits/stdc++.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BVH_X86_SIMD
+#endif
+using namespace std;
+
+// 指令集级别名称
+const char* simdLevelName(int level) {
+    if (level == SIMD_AVX2) return "avx2";
+    if (level == SIMD_SSE) return "sse";
+    return "scalar";
+}
+
+// 检测CPU支持的最高指令集级别
+int detectSimdLevel() {
+#ifdef BVH_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+#ifdef __SSE2__
+    return SIMD_SSE;
+#endif
+#endif
+    return SIMD_SCALAR;
+}
+
+// 设置指令集级别：请求的级别超过CPU支持时自动降级，-1表示自动检测
+void setSimdLevel(int level) {
+    int supported = detectSimdLevel();
+    simdLevel = (level < 0 || level > supported) ? supported : level;
+}
+
+float wideBoxPad = 0;       // 四叉节点包围盒的外扩量（增量更新重新拟合时使用同样的值）
+
+// 把二叉BVH节点写入四叉节点的第slot个子节点
+void setWideChild(WideBVHNode& wide, int slot, const LinearBVHNode& node, float pad) {
+    for (int axis = 0; axis < 3; axis++) {
+        wide.bmin[axis][slot] = node.bmin[axis] - pad;
+        wide.bmax[axis][slot] = node.bmax[axis] + pad;
+    }
+}
+
+// 把以二叉节点index为根的子树折叠成四叉节点（深度优先顺序），返回四叉节点下标
+// 每次展开表面积最大的内部子节点，直到凑满4个子节点
+int collapseBVH(int index, float pad) {
+    int wideIndex = wideNodes.size();
+    wideNodes.push_back(WideBVHNode());
+    
+    int children[4];
+    int childCount = 0;
+    const LinearBVHNode& root = bvhNodes[index];
+    if (root.count > 0) {
+        children[childCount++] = index;
+    } else {
+        children[childCount++] = index + 1;
+        children[childCount++] = root.offset;
+    }
+    
+    while (childCount < 4) {
+        int best = -1;
+        double bestArea = -1.0;
+        for (int i = 0; i < childCount; i++) {
+            const LinearBVHNode& node = bvhNodes[children[i]];
+            if (node.count > 0) continue;
+            double dx = node.bmax[0] - node.bmin[0];
+            double dy = node.bmax[1] - node.bmin[1];
+            double dz = node.bmax[2] - node.bmin[2];
+            double area = dx * dy + dy * dz + dz * dx;
+            if (area > bestArea) {
+                bestArea = area;
+                best = i;
+            }
+        }
+        if (best < 0) break;
+        
+        int opened = children[best];
+        children[best] = opened + 1;
+        children[childCount++] = bvhNodes[opened].offset;
+    }
+    
+    // 先填好本节点再递归（递归会使wideNodes重新分配，故用局部变量）
+    WideBVHNode wide;
+    for (int i = 0; i < 4; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            wide.bmin[axis][i] = INFINITY;
+            wide.bmax[axis][i] = -INFINITY;
+        }
+        wide.child[i] = -1;
+        wide.count[i] = 0;
+    }
+    for (int i = 0; i < childCount; i++) {
+        const LinearBVHNode& node = bvhNodes[children[i]];
+        setWideChild(wide, i, node, pad);
+        if (node.count > 0) {
+            wide.child[i] = node.offset;
+            wide.count[i] = node.count;
+        }
+    }
+    for (int i = 0; i < childCount; i++) {
+        if (bvhNodes[children[i]].count == 0) {
+            wide.child[i] = collapseBVH(children[i], pad);
+        }
+    }
+    
+    wideNodes[wideIndex] = wide;
+    return wideIndex;
+}
+
+// 由线性二叉BVH生成四叉BVH
+void buildWideBVH() {
+    wideNodes.clear();
+    if (bvhNodes.empty()) return;
+    wideNodes.reserve(bvhNodes.size() / 2 + 1);
+    
+    // float光线原点有舍入误差，按场景坐标量级把包围盒再外扩一点
+    float magnitude = 1.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        magnitude = max(magnitude, fabsf(bvhNodes[0].bmin[axis]));
+        magnitude = max(magnitude, fabsf(bvhNodes[0].bmax[axis]));
+    }
+    wideBoxPad = magnitude * 1e-6f;
+    collapseBVH(0, wideBoxPad);
+    resetBVHUpdate();
+    
+    setSimdLevel(simdLevel);
+    cout << "求交内核: " << simdLevelName(simdLevel) << "（CPU支持 " 
+         << simdLevelName(detectSimdLevel()) << "）" << endl;
+}
+
+// 四叉遍历用的光线参数（float，供SIMD内核使用）
+struct WideRay {
+    float origin[3];
+    float invDir[3];
+    int dirNeg[3];
+    
+    WideRay() {}
+    WideRay(const RayTraversal& rt) {
+        for (int i = 0; i < 3; i++) {
+            origin[i] = (float)rt.origin[i];
+            invDir[i] = (float)rt.invDir[i];
+            dirNeg[i] = rt.invDir[i] < 0;
+        }
+    }
+};
+
+// 标量内核：逐个测试四个子节点包围盒，返回命中掩码和进入距离
+inline int intersectChildrenScalar(const WideBVHNode& node, const WideRay& wr,
+                                   float tLimit, float tNear[4]) {
+    int mask = 0;
+    for (int c = 0; c < 4; c++) {
+        float t0 = -1e30f, t1 = 1e30f;
+        for (int axis = 0; axis < 3; axis++) {
+            float nearPlane = wr.dirNeg[axis] ? node.bmax[axis][c] : node.bmin[axis][c];
+            float farPlane = wr.dirNeg[axis] ? node.bmin[axis][c] : node.bmax[axis][c];
+            t0 = max(t0, (nearPlane - wr.origin[axis]) * wr.invDir[axis]);
+            t1 = min(t1, (farPlane - wr.origin[axis]) * wr.invDir[axis]);
+        }
+        t1 *= 1.00001f;
+        tNear[c] = t0;
+        if (t0 <= t1 && t1 > 1e-6f && t0 <= tLimit) mask |= 1 << c;
+    }
+    return mask;
+}
+
+#ifdef __SSE2__
+// SSE内核：一次测试四个子节点包围盒
+inline int intersectChildrenSSE(const WideBVHNode& node, const WideRay& wr,
+                                float tLimit, float tNear[4]) {
+    __m128 t0 = _mm_set1_ps(-1e30f);
+    __m128 t1 = _mm_set1_ps(1e30f);
+    for (int axis = 0; axis < 3; axis++) {
+        __m128 o = _mm_set1_ps(wr.origin[axis]);
+        __m128 inv = _mm_set1_ps(wr.invDir[axis]);
+        __m128 lo = _mm_load_ps(node.bmin[axis]);
+        __m128 hi = _mm_load_ps(node.bmax[axis]);
+        __m128 nearPlane = wr.dirNeg[axis] ? hi : lo;
+        __m128 farPlane = wr.dirNeg[axis] ? lo : hi;
+        t0 = _mm_max_ps(t0, _mm_mul_ps(_mm_sub_ps(nearPlane, o), inv));
+        t1 = _mm_min_ps(t1, _mm_mul_ps(_mm_sub_ps(farPlane, o), inv));
+    }
+    t1 = _mm_mul_ps(t1, _mm_set1_ps(1.00001f));
+    _mm_storeu_ps(tNear, t0);
+    
+    __m128 ok = _mm_and_ps(_mm_cmple_ps(t0, t1), _mm_cmpgt_ps(t1, _mm_set1_ps(1e-6f)));
+    ok = _mm_and_ps(ok, _mm_cmple_ps(t0, _mm_set1_ps(tLimit)));
+    return _mm_movemask_ps(ok);
+}
+#endif
+
+#ifdef BVH_X86_SIMD
+// 从SoA热数据读取4个三角形的某个分量并转为double
+__attribute__((target("avx2")))
+inline __m256d loadLanes(const MappedArray<float>& data, int start) {
+    return _mm256_cvtps_pd(_mm_loadu_ps(&data[start]));
+}
+
+// AVX2内核：4个三角形同时做M?ller-Trumbore测试（double精度，与标量结果一致），返回命中掩码和t
+__attribute__((target("avx2")))
+int intersectTriangles4AVX2(const TriangleGeometry& g, const Ray& ray, int start, double tMax, 
+                            double tOut[4], double uOut[4], double vOut[4]) {
+    const __m256d eps = _mm256_set1_pd(1e-6);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    
+    __m256d e1x = loadLanes(g.e1[0], start), e1y = loadLanes(g.e1[1], start), e1z = loadLanes(g.e1[2], start);
+    __m256d e2x = loadLanes(g.e2[0], start), e2y = loadLanes(g.e2[1], start), e2z = loadLanes(g.e2[2], start);
+    __m256d dx = _mm256_set1_pd(ray.direction[0]);
+    __m256d dy = _mm256_set1_pd(ray.direction[1]);
+    __m256d dz = _mm256_set1_pd(ray.direction[2]);
+    
+    // h = d × e2, a = e1 · h
+    __m256d hx = _mm256_sub_pd(_mm256_mul_pd(dy, e2z), _mm256_mul_pd(dz, e2y));
+    __m256d hy = _mm256_sub_pd(_mm256_mul_pd(dz, e2x), _mm256_mul_pd(dx, e2z));
+    __m256d hz = _mm256_sub_pd(_mm256_mul_pd(dx, e2y), _mm256_mul_pd(dy, e2x));
+    __m256d a = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e1x, hx), _mm256_mul_pd(e1y, hy)),
+                              _mm256_mul_pd(e1z, hz));
+    __m256d absA = _mm256_andnot_pd(_mm256_set1_pd(-0.0), a);
+    __m256d valid = _mm256_cmp_pd(absA, eps, _CMP_GE_OQ);
+    __m256d f = _mm256_div_pd(one, a);
+    
+    // s = o - v0, u = f * (s · h)
+    __m256d sx = _mm256_sub_pd(_mm256_set1_pd(ray.origin[0]), loadLanes(g.v0[0], start));
+    __m256d sy = _mm256_sub_pd(_mm256_set1_pd(ray.origin[1]), loadLanes(g.v0[1], start));
+    __m256d sz = _mm256_sub_pd(_mm256_set1_pd(ray.origin[2]), loadLanes(g.v0[2], start));
+    __m256d u = _mm256_mul_pd(f, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(sx, hx), _mm256_mul_pd(sy, hy)),
+                                               _mm256_mul_pd(sz, hz)));
+    valid = _mm256_and_pd(valid, _mm256_cmp_pd(u, zero, _CMP_GE_OQ));
+    valid = _mm256_and_pd(valid, _mm256_cmp_pd(u, one, _CMP_LE_OQ));
+    
+    // q = s × e1, v = f * (d · q), t = f * (e2 · q)
+    __m256d qx = _mm256_sub_pd(_mm256_mul_pd(sy, e1z), _mm256_mul_pd(sz, e1y));
+    __m256d qy = _mm256_sub_pd(_mm256_mul_pd(sz, e1x), _mm256_mul_pd(sx, e1z));
+    __m256d qz = _mm256_sub_pd(_mm256_mul_pd(sx, e1y), _mm256_mul_pd(sy, e1x));
+    __m256d v = _mm256_mul_pd(f, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, qx), _mm256_mul_pd(dy, qy)),
+                                               _mm256_mul_pd(dz, qz)));
+    valid = _mm256_and_pd(valid, _mm256_cmp_pd(v, zero, _CMP_GE_OQ));
+    valid = _mm256_and_pd(valid, _mm256_cmp_pd(_mm256_add_pd(u, v), one, _CMP_LE_OQ));
+    
+    __m256d t = _mm256_mul_pd(f, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e2x, qx), _mm256_mul_pd(e2y, qy)),
+                                               _mm256_mul_pd(e2z, qz)));
+    valid = _mm256_and_pd(valid, _mm256_cmp_pd(t, eps, _CMP_GT_OQ));
+    valid = _mm256_and_pd(valid, _mm256_cmp_pd(t, _mm256_set1_pd(tMax), _CMP_LT_OQ));
+    
+    _mm256_storeu_pd(tOut, t);
+    _mm256_storeu_pd(uOut, u);
+    _mm256_storeu_pd(vOut, v);
+    return _mm256_movemask_pd(valid);
+}
+#endif
+
+// 可见三角形掩码（appear）
+inline int visibleMask(const WideBVH& bvh, int start, int count) {
+    int mask = 0;
+    for (int k = 0; k < count; k++) {
+        if (appear[bvh.indices[start + k]] == 1) mask |= 1 << k;
+    }
+    return mask;
+}
+
+// 叶子最近命中测试
+template <int LEVEL>
+inline void intersectLeaf(const WideBVH& bvh, const Ray& ray, int start, int count, HitRecord& hit) {
+#ifdef BVH_X86_SIMD
+    if (LEVEL == SIMD_AVX2) {
+        double t[4], u[4], v[4];
+        for (int base = start; base < start + count; base += 4) {
+            int lanes = min(4, start + count - base);
+            int mask = intersectTriangles4AVX2(bvh.geometry, ray, base, hit.t, t, u, v) & visibleMask(bvh, base, lanes);
+            for (int k = 0; mask != 0; k++, mask >>= 1) {
+                if ((mask & 1) && t[k] < hit.t) {
+                    hit.t = t[k];
+                    hit.prim = base + k;
+                    hit.baryU = u[k];
+                    hit.baryV = v[k];
+                    hit.hit = true;
+                }
+            }
+        }
+        return;
+    }
+#endif
+    for (int i = start; i < start + count; i++) {
+        if(appear[bvh.indices[i]] == 1)
+            intersectTriangle(bvh.geometry, ray, i, hit);
+    }
+}
+
+// 叶子遮挡测试，返回是否找到完全遮挡物
+template <int LEVEL>
+inline bool occludedLeaf(const WideBVH& bvh, const Ray& ray, int start, int count, double tMax, bool* partial) {
+#ifdef BVH_X86_SIMD
+    if (LEVEL == SIMD_AVX2) {
+        double t[4], u[4], v[4];
+        for (int base = start; base < start + count; base += 4) {
+            int lanes = min(4, start + count - base);
+            int mask = intersectTriangles4AVX2(bvh.geometry, ray, base, tMax, t, u, v) & visibleMask(bvh, base, lanes);
+            for (int k = 0; mask != 0; k++, mask >>= 1) {
+                if (!(mask & 1)) continue;
+                if (partial != nullptr && triangles[bvh.indices[base + k]].materialType == 3) {
+                    *partial = true;
+                    continue;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+#endif
+    for (int i = start; i < start + count; i++) {
+        int id = bvh.indices[i];
+        if (appear[id] != 1 || !occludesTriangle(bvh.geometry, ray, i, tMax)) continue;
+        if (partial != nullptr && triangles[id].materialType == 3) {
+            *partial = true;
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+// 测试四个子节点包围盒（按指令集级别选择内核）
+template <int LEVEL>
+inline int intersectChildren(const WideBVHNode& node, const WideRay& wr, float tLimit, float tNear[4]) {
+#ifdef __SSE2__
+    if (LEVEL >= SIMD_SSE) return intersectChildrenSSE(node, wr, tLimit, tNear);
+#endif
+    return intersectChildrenScalar(node, wr, tLimit, tNear);
+}
+
+// 遍历栈元素：count>0表示叶子（child为三角形起始位置），否则child为四叉节点下标
+struct WideStackEntry {
+    int child;
+    int count;
+    float t;
+};
+
+// 四叉BVH最近命中遍历（显式栈，子节点按进入距离由近到远访问），root为起始四叉节点
+template <int LEVEL>
+void intersectWideBVH(const WideBVH& bvh, const Ray& ray, HitRecord& hit, int root = 0) {
+    RayTraversal rt(ray);
+    WideRay wr(rt);
+    const WideBVHNode* nodes = bvh.nodes.data();
+    
+    WideStackEntry stack[3 * BVH_STACK_SIZE + 4];
+    int stackSize = 0;
+    stack[stackSize++] = {root, 0, -1e30f};
+    
+    while (stackSize > 0) {
+        WideStackEntry entry = stack[--stackSize];
+        if (entry.t > hit.t) continue;   // 已有更近的交点
+        
+        if (entry.count > 0) {
+            intersectLeaf<LEVEL>(bvh, ray, entry.child, entry.count, hit);
+            continue;
+        }
+        
+        const WideBVHNode& node = nodes[entry.child];
+        float tNear[4];
+        int mask = intersectChildren<LEVEL>(node, wr, (float)min(hit.t * 1.00001, 1e30), tNear);
+        if (mask == 0) continue;
+        
+        // 命中的子节点按进入距离从远到近入栈，最近的最先出栈
+        int order[4], hitCount = 0;
+        for (int c = 0; c < 4; c++) {
+            if (!(mask & (1 << c))) continue;
+            int k = hitCount++;
+            while (k > 0 && tNear[order[k - 1]] < tNear[c]) {
+                order[k] = order[k - 1];
+                k--;
+            }
+            order[k] = c;
+        }
+        for (int k = 0; k < hitCount; k++) {
+            int c = order[k];
+            stack[stackSize++] = {node.child[c], node.count[c], tNear[c]};
+        }
+    }
+}
+
+// 四叉BVH遮挡遍历（任意命中）
+template <int LEVEL>
+bool occludedWideBVH(const WideBVH& bvh, const Ray& ray, double tMax, bool* partial) {
+    RayTraversal rt(ray);
+    WideRay wr(rt);
+    const WideBVHNode* nodes = bvh.nodes.data();
+    float tLimit = (float)min(tMax * 1.00001, 1e30);
+    
+    int stack[3 * BVH_STACK_SIZE + 4];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    
+    while (stackSize > 0) {
+        const WideBVHNode& node = nodes[stack[--stackSize]];
+        float tNear[4];
+        int mask = intersectChildren<LEVEL>(node, wr, tLimit, tNear);
+        
+        for (int c = 0; c < 4; c++) {
+            if (!(mask & (1 << c))) continue;
+            if (node.count[c] > 0) {
+                if (occludedLeaf<LEVEL>(bvh, ray, node.child[c], node.count[c], tMax, partial)) return true;
+            } else {
+                stack[stackSize++] = node.child[c];
+            }
+        }
+    }
+    
+    return false;
+}
+
+// BVH遍历与相交测试（按运行时指令集级别分派）
+void intersectBVH(const Ray& ray, HitRecord& hit) {
+    if (wideNodes.empty()) return;
+    switch (simdLevel) {
+        case SIMD_AVX2: intersectWideBVH<SIMD_AVX2>(sceneBVH, ray, hit); break;
+        case SIMD_SSE: intersectWideBVH<SIMD_SSE>(sceneBVH, ray, hit); break;
+        default: intersectWideBVH<SIMD_SCALAR>(sceneBVH, ray, hit); break;
+    }
+}
+
+// BVH遮挡查询（任意命中）：找到第一个遮挡物立即返回
+// partial非空时，材质3的三角形只算部分遮挡：记录到*partial并继续寻找完全遮挡物
+bool occludedBVH(const Ray& ray, double tMax, bool* partial) {
+    if (wideNodes.empty()) return false;
+    switch (simdLevel) {
+        case SIMD_AVX2: return occludedWideBVH<SIMD_AVX2>(sceneBVH, ray, tMax, partial);
+        case SIMD_SSE: return occludedWideBVH<SIMD_SSE>(sceneBVH, ray, tMax, partial);
+        default: return occludedWideBVH<SIMD_SCALAR>(sceneBVH, ray, tMax, partial);
+    }
+}